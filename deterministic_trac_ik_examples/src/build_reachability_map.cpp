@@ -0,0 +1,101 @@
+/********************************************************************************
+Copyright (c) 2016, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <ros/ros.h>
+#include <deterministic_trac_ik/reachability_map.hpp>
+#include <deterministic_trac_ik/utils.h>
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "build_reachability_map");
+    ros::NodeHandle nh("~");
+
+    std::string chain_start;
+    std::string chain_end;
+    std::string output_file;
+    double resolution;
+    int num_samples;
+    int num_threads;
+
+    nh.param("chain_start", chain_start, std::string(""));
+    nh.param("chain_end", chain_end, std::string(""));
+    nh.param("output_file", output_file, std::string(""));
+
+    if (chain_start == "" || chain_end == "" || output_file == "") {
+        ROS_FATAL("Missing chain info or output file in launch file");
+        exit(-1);
+    }
+
+    nh.param("resolution", resolution, 0.02);
+    nh.param("num_samples", num_samples, 10000000);
+    nh.param("num_threads", num_threads, 0);
+
+    urdf::Model robot_model;
+    if (!Deterministic_TRAC_IK::LoadModelOverride(nh, "robot_description", robot_model)) {
+        ROS_FATAL("Failed to load robot model");
+        exit(-1);
+    }
+
+    KDL::Chain chain;
+    std::vector<std::string> link_names;
+    std::vector<std::string> joint_names;
+    KDL::JntArray joint_min;
+    KDL::JntArray joint_max;
+    if (!Deterministic_TRAC_IK::InitKDLChain(
+        robot_model, chain_start, chain_end,
+        chain, link_names, joint_names, joint_min, joint_max))
+    {
+        ROS_FATAL("Failed to initialize KDL chain");
+        exit(-1);
+    }
+
+    ROS_INFO("Sampling %d configurations of %s -> %s at %g m resolution", num_samples, chain_start.c_str(), chain_end.c_str(), resolution);
+
+    Deterministic_TRAC_IK::ReachabilityMap map;
+
+    auto before = std::chrono::high_resolution_clock::now();
+    if (!map.build(chain, joint_min, joint_max, resolution, num_samples, std::max(0, num_threads))) {
+        ROS_FATAL("Failed to build reachability map");
+        exit(-1);
+    }
+    auto after = std::chrono::high_resolution_clock::now();
+
+    ROS_INFO("Built reachability map in %f secs", std::chrono::duration<double>(after - before).count());
+
+    if (!map.save(output_file)) {
+        ROS_FATAL("Failed to write reachability map to %s", output_file.c_str());
+        exit(-1);
+    }
+
+    ROS_INFO("Wrote reachability map to %s", output_file.c_str());
+    return 0;
+}
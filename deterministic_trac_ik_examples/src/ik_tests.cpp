@@ -35,13 +35,102 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <deterministic_trac_ik/deterministic_trac_ik.hpp>
 #include <deterministic_trac_ik/utils.h>
 
+// Time the NLopt solver alone on each combination of objective and algorithm.
+void testNLOptMatrix(
+    const KDL::Chain& chain,
+    const KDL::JntArray& joint_min,
+    const KDL::JntArray& joint_max,
+    int max_iterations,
+    double eps,
+    const KDL::JntArray& nominal,
+    const std::vector<KDL::JntArray>& position_samples)
+{
+    struct Objective
+    {
+        const char* name;
+        NLOPT_IK::OptType type;
+    };
+    const Objective objectives[] = {
+        { "sum_squares", NLOPT_IK::SumSq },
+        { "l2", NLOPT_IK::L2 },
+        { "dual_quaternion", NLOPT_IK::DualQuat },
+        { "joint", NLOPT_IK::Joint },
+    };
+
+    struct Algorithm
+    {
+        const char* name;
+        nlopt::algorithm algorithm;
+    };
+    const Algorithm algorithms[] = {
+        { "slsqp", nlopt::LD_SLSQP },
+        { "lbfgs", nlopt::LD_LBFGS },
+        { "mma", nlopt::LD_MMA },
+        { "ccsaq", nlopt::LD_CCSAQ },
+    };
+
+    KDL::ChainFkSolverPos_recursive fk_solver(chain);
+    const int num_samples = position_samples.size();
+
+    std::string best;
+    int best_success = -1;
+    double best_time = 0.0;
+
+    ROS_INFO_STREAM("*** Testing NLopt objectives and algorithms with " << num_samples << " random samples");
+
+    for (const Objective& objective : objectives) {
+        for (const Algorithm& algorithm : algorithms) {
+            // the Joint objective needs equality constraints
+            if (objective.type == NLOPT_IK::Joint && algorithm.algorithm != nlopt::LD_SLSQP) {
+                continue;
+            }
+
+            Deterministic_TRAC_IK::Deterministic_TRAC_IK solver(
+                    chain, joint_min, joint_max, max_iterations, eps, Deterministic_TRAC_IK::Speed);
+            solver.setSolverEnabled(Deterministic_TRAC_IK::Deterministic_TRAC_IK::KDLSolver, false);
+            solver.setNLOptType(objective.type);
+            solver.setNLOptAlgorithm(algorithm.algorithm);
+
+            KDL::JntArray result;
+            double total_time = 0.0;
+            int success = 0;
+
+            for (int i = 0; i < num_samples; i++) {
+                KDL::Frame end_effector_pose;
+                fk_solver.JntToCart(position_samples[i], end_effector_pose);
+
+                auto before = std::chrono::high_resolution_clock::now();
+                int rc = solver.CartToJnt(nominal, end_effector_pose, result);
+                auto after = std::chrono::high_resolution_clock::now();
+
+                total_time += std::chrono::duration<double>(after - before).count();
+                if (rc >= 0) {
+                    ++success;
+                }
+            }
+
+            const std::string name = std::string(objective.name) + "/" + algorithm.name;
+            ROS_INFO_STREAM("NLopt " << name << " found " << success << " solutions (" << 100.0 * success / num_samples << "\%) with an average of " << total_time / num_samples << " secs per sample");
+
+            if (success > best_success || (success == best_success && total_time < best_time)) {
+                best = name;
+                best_success = success;
+                best_time = total_time;
+            }
+        }
+    }
+
+    ROS_INFO_STREAM("Best NLopt combination for this chain: " << best);
+}
+
 void test(
     ros::NodeHandle& nh,
     int num_samples,
     const std::string& chain_start,
     const std::string& chain_end,
     int max_iterations,
-    const std::string& urdf_param)
+    const std::string& urdf_param,
+    bool nlopt_matrix)
 {
     double eps = 1e-5;
 
@@ -191,6 +280,10 @@ void test(
     }
 
     ROS_INFO_STREAM("TRAC-IK found " << success << " solutions (" << 100.0 * success / num_samples << "\%) with an average of " << total_time / num_samples << " secs per sample");
+
+    if (nlopt_matrix) {
+        testNLOptMatrix(chain, joint_min, joint_max, max_iterations, eps, nominal, position_samples);
+    }
 }
 
 int main(int argc, char** argv)
@@ -204,6 +297,7 @@ int main(int argc, char** argv)
     std::string chain_end;
     std::string urdf_param;
     int max_iterations;
+    bool nlopt_matrix;
 
     nh.param("num_samples", num_samples, 1000);
     nh.param("chain_start", chain_start, std::string(""));
@@ -216,12 +310,13 @@ int main(int argc, char** argv)
 
     nh.param("max_iterations", max_iterations, 100);
     nh.param("urdf_param", urdf_param, std::string("/robot_description"));
+    nh.param("nlopt_matrix", nlopt_matrix, false);
 
     if (num_samples < 1) {
         num_samples = 1;
     }
 
-    test(nh, num_samples, chain_start, chain_end, max_iterations, urdf_param);
+    test(nh, num_samples, chain_start, chain_end, max_iterations, urdf_param, nlopt_matrix);
 
     // Useful when you make a script that loops over multiple launch files that test different robot chains
     // std::vector<char *> commandVector;
@@ -0,0 +1,215 @@
+/********************************************************************************
+Copyright (c) 2016, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ros/ros.h>
+#include <deterministic_trac_ik/compiled_chain.hpp>
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/query_log.hpp>
+#include <deterministic_trac_ik/utils.h>
+
+// Return the p'th percentile of sorted, in microseconds.
+double Percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t i = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return 1e-3 * sorted[i];
+}
+
+void PrintLatencies(const char* label, std::vector<uint64_t>& durations)
+{
+    std::sort(durations.begin(), durations.end());
+    ROS_INFO("%s latency (us): p50 %.1f, p90 %.1f, p99 %.1f, max %.1f",
+            label,
+            Percentile(durations, 0.5),
+            Percentile(durations, 0.9),
+            Percentile(durations, 0.99),
+            durations.empty() ? 0.0 : 1e-3 * durations.back());
+}
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "replay_queries");
+    ros::NodeHandle nh("~");
+
+    std::string chain_start;
+    std::string chain_end;
+    std::string capture_file;
+
+    nh.param("chain_start", chain_start, std::string(""));
+    nh.param("chain_end", chain_end, std::string(""));
+    nh.param("capture_file", capture_file, std::string(""));
+
+    if (chain_start == "" || chain_end == "" || capture_file == "") {
+        ROS_FATAL("Missing chain info or capture file in launch file");
+        exit(-1);
+    }
+
+    urdf::Model robot_model;
+    if (!Deterministic_TRAC_IK::LoadModelOverride(nh, "robot_description", robot_model)) {
+        ROS_FATAL("Failed to load robot model");
+        exit(-1);
+    }
+
+    KDL::Chain chain;
+    std::vector<std::string> link_names;
+    std::vector<std::string> joint_names;
+    KDL::JntArray joint_min;
+    KDL::JntArray joint_max;
+    if (!Deterministic_TRAC_IK::InitKDLChain(
+        robot_model, chain_start, chain_end,
+        chain, link_names, joint_names, joint_min, joint_max))
+    {
+        ROS_FATAL("Failed to initialize KDL chain");
+        exit(-1);
+    }
+
+    std::vector<Deterministic_TRAC_IK::QueryRecord> records;
+    uint64_t chain_signature;
+    Deterministic_TRAC_IK::SolverOptions options;
+    if (!Deterministic_TRAC_IK::QueryLog::read(capture_file, records, chain_signature, options)) {
+        ROS_FATAL("Failed to read query log %s", capture_file.c_str());
+        exit(-1);
+    }
+
+    // their results depend on state that was not recorded
+    if (options.external != 0) {
+        ROS_FATAL("Query log %s was recorded with an IK cache, reachability map or analytic solver, which cannot be replayed", capture_file.c_str());
+        exit(-1);
+    }
+
+    // solve on the same chain as the plugin, whose fused fixed segments
+    // round differently
+    if (options.compiled_chain) {
+        Deterministic_TRAC_IK::CompiledChain compiled(chain, joint_names, joint_min, joint_max);
+        if (!compiled.valid()) {
+            ROS_FATAL("Failed to compile KDL chain");
+            exit(-1);
+        }
+        chain = compiled.chain();
+        joint_min = compiled.lowerLimits();
+        joint_max = compiled.upperLimits();
+    }
+
+    if (records.empty()) {
+        ROS_INFO("Query log %s is empty", capture_file.c_str());
+        return 0;
+    }
+
+    if (chain_signature != Deterministic_TRAC_IK::ChainSignature(chain)) {
+        ROS_WARN("Query log %s was recorded for a different chain; results will not match", capture_file.c_str());
+    }
+
+    if (records.front().seed.rows() != chain.getNrOfJoints()) {
+        ROS_FATAL("Query log %s has %u joints, but the chain has %u", capture_file.c_str(), records.front().seed.rows(), chain.getNrOfJoints());
+        exit(-1);
+    }
+
+    Deterministic_TRAC_IK::Deterministic_TRAC_IK solver(
+            chain, joint_min, joint_max,
+            records.front().max_iterations, records.front().eps);
+    solver.setSolverOptions(options);
+
+    ROS_INFO("Replaying %zu queries from %s", records.size(), capture_file.c_str());
+
+    std::vector<uint64_t> captured_durations;
+    std::vector<uint64_t> replayed_durations;
+    int captured_successes = 0;
+    int replayed_successes = 0;
+    int result_mismatches = 0;
+    int solution_mismatches = 0;
+    int skipped = 0;
+    double max_joint_diff = 0.0;
+
+    KDL::JntArray q_out;
+    for (const Deterministic_TRAC_IK::QueryRecord& record : records) {
+        // the decisions of a solution filter were not recorded
+        if (record.filtered) {
+            ++skipped;
+            continue;
+        }
+
+        if (record.eps != records.front().eps) {
+            ++skipped;
+            continue;
+        }
+
+        solver.SetSolveType((Deterministic_TRAC_IK::SolveType)record.solve_type);
+        solver.setMaxIterations(record.max_iterations);
+        solver.setCostBudget(record.cost_budget);
+        solver.setPerQuerySeeding(record.per_query_seeding, record.seed_salt);
+
+        auto before = std::chrono::steady_clock::now();
+        int rc = solver.CartToJnt(
+                record.seed, record.pose, q_out, record.bounds, record.consistency_limits);
+        auto after = std::chrono::steady_clock::now();
+
+        captured_durations.push_back(record.duration_ns);
+        replayed_durations.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+
+        if (record.result >= 0) {
+            ++captured_successes;
+        }
+        if (rc >= 0) {
+            ++replayed_successes;
+        }
+
+        if ((rc >= 0) != (record.result >= 0) || (rc < 0 && rc != record.result)) {
+            ++result_mismatches;
+        }
+        else if (rc >= 0) {
+            bool identical = true;
+            for (unsigned int j = 0; j < q_out.rows(); ++j) {
+                identical &= q_out(j) == record.solution(j);
+                max_joint_diff = std::max(max_joint_diff, std::fabs(q_out(j) - record.solution(j)));
+            }
+            if (!identical) {
+                ++solution_mismatches;
+            }
+        }
+    }
+
+    const size_t replayed = replayed_durations.size();
+    if (skipped > 0) {
+        ROS_INFO("Skipped %d queries with a solution filter or a different epsilon", skipped);
+    }
+    ROS_INFO("Captured success: %d / %zu", captured_successes, replayed);
+    ROS_INFO("Replayed success: %d / %zu", replayed_successes, replayed);
+    ROS_INFO("Result mismatches: %d, solution mismatches: %d (max joint difference %g)", result_mismatches, solution_mismatches, max_joint_diff);
+    PrintLatencies("Captured", captured_durations);
+    PrintLatencies("Replayed", replayed_durations);
+
+    return 0;
+}
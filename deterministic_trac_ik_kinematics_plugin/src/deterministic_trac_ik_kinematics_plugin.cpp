@@ -31,11 +31,18 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "deterministic_trac_ik_kinematics_plugin.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include <kdl/tree.hpp>
 #include <ros/ros.h>
+#include <std_srvs/Empty.h>
 #include <tf_conversions/tf_kdl.h>
+#include <deterministic_trac_ik/compiled_chain.hpp>
 #include <deterministic_trac_ik/deterministic_trac_ik.hpp>
 #include <deterministic_trac_ik/utils.h>
 #include <urdf/model.h>
@@ -56,6 +63,59 @@ bool LoadModelOverride(
   return true;
 }
 
+namespace {
+
+// MoveIt instantiates the plugin once per thread for a group, so the
+// telemetry of a group is kept once per process, and served and written by
+// whichever instance comes first.
+struct GroupTelemetry
+{
+    Deterministic_TRAC_IK::IKTelemetry telemetry;
+    std::string file;
+    std::string group_name;
+    ros::ServiceServer service;
+
+    ~GroupTelemetry()
+    {
+        telemetry.save(file, group_name);
+    }
+
+    bool dump(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res)
+    {
+        return telemetry.save(file, group_name);
+    }
+};
+
+std::shared_ptr<Deterministic_TRAC_IK::IKTelemetry> GetGroupTelemetry(
+    ros::NodeHandle& node_handle,
+    const std::string& group_name,
+    const std::string& file)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<GroupTelemetry>> groups;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<GroupTelemetry> group = groups[group_name].lock();
+    if (!group) {
+        group = std::make_shared<GroupTelemetry>();
+        group->file = file;
+        group->group_name = group_name;
+        group->service = node_handle.advertiseService(
+                group_name + "/dump_ik_telemetry",
+                &GroupTelemetry::dump,
+                group.get());
+        groups[group_name] = group;
+    }
+    else if (group->file != file) {
+        ROS_WARN_NAMED("deterministic_trac_ik", "Telemetry of group %s is already written to %s", group_name.c_str(), group->file.c_str());
+    }
+
+    // the aliasing constructor keeps the group alive with the telemetry
+    return std::shared_ptr<Deterministic_TRAC_IK::IKTelemetry>(group, &group->telemetry);
+}
+
+} // namespace
+
 bool Deterministic_TRAC_IKKinematicsPlugin::initialize(
     const moveit::core::RobotModel& robot_model,
     const std::string& group_name,
@@ -77,22 +137,86 @@ bool Deterministic_TRAC_IKKinematicsPlugin::initialize(
 
     ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik","Reading joints and links from URDF");
 
-    if(tip_frames.empty() or tip_frames.size() > 1)
-    {
-        ROS_WARN_STREAM_NAMED("deterministic_trac_ik","tip frames must be exactly one");
+    if (tip_frames.empty()) {
+        ROS_WARN_STREAM_NAMED("deterministic_trac_ik","at least one tip frame is required");
         return false;
     }
 
-    if (!Deterministic_TRAC_IK::InitKDLChain(
-        *model, base_name, tip_frames[0],
-        chain_, link_names_, joint_names_, joint_min_, joint_max_))
-    {
-        ROS_WARN_STREAM_NAMED("deterministic_trac_ik", "Failed to initialize KDL chain");
-        return false;
+    // several tip frames are solved jointly over the union of their chains
+    KDL::Tree tree;
+    bool compiled_chain = false;
+    if (tip_frames.size() > 1) {
+        if (!Deterministic_TRAC_IK::InitKDLTree(
+            *model, base_name, tip_frames,
+            tree, link_names_, joint_names_, joint_min_, joint_max_))
+        {
+            ROS_WARN_STREAM_NAMED("deterministic_trac_ik", "Failed to initialize KDL tree");
+            return false;
+        }
+    }
+    else {
+        // a chain compiled by a previous run skips extracting it from the
+        // robot description. Compiling fuses fixed links, so it is only done
+        // when caching is enabled; otherwise every link of the chain stays
+        // available to getPositionFK.
+        std::string chain_cache_dir;
+        lookupParam("chain_cache_dir", chain_cache_dir, std::string());
+        compiled_chain = !chain_cache_dir.empty();
+
+        if (chain_cache_dir.empty()) {
+            if (!Deterministic_TRAC_IK::InitKDLChain(
+                *model, base_name, tip_frames[0],
+                chain_, link_names_, joint_names_, joint_min_, joint_max_))
+            {
+                ROS_WARN_STREAM_NAMED("deterministic_trac_ik", "Failed to initialize KDL chain");
+                return false;
+            }
+        }
+        else {
+            const std::string chain_name = base_name + '\n' + tip_frames[0];
+            const uint64_t source_key = Deterministic_TRAC_IK::HashBytes(
+                    chain_name.data(), chain_name.size(),
+                    Deterministic_TRAC_IK::ModelSignature(*model));
+            const std::string chain_file = chain_cache_dir + "/" + model->getName() + "-" + group_name + ".chain";
+
+            Deterministic_TRAC_IK::CompiledChain compiled;
+            if (compiled.load(chain_file, source_key)) {
+                ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Loaded compiled chain %s", chain_file.c_str());
+            }
+            else {
+                KDL::Chain chain;
+                std::vector<std::string> link_names;
+                std::vector<std::string> joint_names;
+                KDL::JntArray joint_min, joint_max;
+                if (!Deterministic_TRAC_IK::InitKDLChain(
+                    *model, base_name, tip_frames[0],
+                    chain, link_names, joint_names, joint_min, joint_max))
+                {
+                    ROS_WARN_STREAM_NAMED("deterministic_trac_ik", "Failed to initialize KDL chain");
+                    return false;
+                }
+
+                compiled = Deterministic_TRAC_IK::CompiledChain(chain, joint_names, joint_min, joint_max);
+                if (!compiled.valid()) {
+                    ROS_WARN_STREAM_NAMED("deterministic_trac_ik", "Failed to compile KDL chain");
+                    return false;
+                }
+                if (compiled.save(chain_file, source_key)) {
+                    ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Saved compiled chain %s", chain_file.c_str());
+                }
+            }
+
+            chain_ = compiled.chain();
+            link_names_ = compiled.linkNames();
+            joint_names_ = compiled.jointNames();
+            joint_min_ = compiled.lowerLimits();
+            joint_max_ = compiled.upperLimits();
+        }
     }
 
-    tmp_in_.resize(chain_.getNrOfJoints());
-    tmp_out_.resize(chain_.getNrOfJoints());
+    tmp_in_.resize(joint_names_.size());
+    tmp_out_.resize(joint_names_.size());
+    tmp_consistency_.resize(joint_names_.size());
 
     lookupParam("position_only_ik", position_ik_, false);
     ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik plugin", "Position only IK = " << position_ik_);
@@ -129,13 +253,284 @@ bool Deterministic_TRAC_IKKinematicsPlugin::initialize(
     double epsilon;
     lookupParam("epsilon", epsilon, 1e-5);
 
+    bool per_query_seeding;
+    int seed_salt;
+    lookupParam("per_query_seeding", per_query_seeding, false);
+    lookupParam("seed_salt", seed_salt, 0);
+    ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik plugin", "Per-query seeding = " << per_query_seeding);
+
+    if (tip_frames.size() > 1) {
+        tree_solver_.reset(new Deterministic_TRAC_IK::TreeIkSolver(
+                tree, base_name, tip_frames, joint_min_, joint_max_, 1000, epsilon));
+        if (!tree_solver_->valid()) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to build the tree solver for group %s", group_name.c_str());
+            tree_solver_.reset();
+            return false;
+        }
+        tree_solver_->setPerQuerySeeding(per_query_seeding, seed_salt);
+
+        KDL::AdaptiveDamping damping = tree_solver_->damping();
+        lookupParam("singularity_threshold", damping.threshold, damping.threshold);
+        lookupParam("max_damping", damping.max_damping, damping.max_damping);
+        tree_solver_->setDamping(damping);
+
+        ROS_INFO_NAMED("deterministic_trac_ik plugin", "Solving %zu tip frames of group %s jointly", tip_frames.size(), group_name.c_str());
+        active_ = true;
+        return true;
+    }
+
+    std::vector<std::string> analytic_solver_libraries;
+    lookupParam("analytic_solver_libraries", analytic_solver_libraries, std::vector<std::string>());
+    for (const auto& library : analytic_solver_libraries) {
+        Deterministic_TRAC_IK::AnalyticSolverRegistry::instance().load(library);
+    }
+
     solver_.reset(new Deterministic_TRAC_IK::Deterministic_TRAC_IK(
             chain_, joint_min_, joint_max_, 1000, epsilon, solve_type_));
+    solver_->setPerQuerySeeding(per_query_seeding, seed_salt);
+
+    if (solver_->getAnalyticSolver()) {
+        ROS_INFO_NAMED("deterministic_trac_ik plugin", "Using analytic solver for group %s", group_name.c_str());
+    } else {
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "No analytic solver for chain signature %016llx", (unsigned long long)Deterministic_TRAC_IK::ChainSignature(chain_));
+    }
+
+    std::string velocity_solver;
+    lookupParam("velocity_solver", velocity_solver, std::string("pinv"));
+    ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Using velocity solver %s", velocity_solver.c_str());
+
+    if (velocity_solver == "dls") {
+        solver_->setVelSolver(KDL::VelSolverDLS);
+    }
+    else if (velocity_solver == "transpose") {
+        solver_->setVelSolver(KDL::VelSolverTranspose);
+    }
+    else {
+        if (velocity_solver != "pinv") {
+            ROS_WARN_STREAM_NAMED("deterministic_trac_ik", velocity_solver << " is not a valid velocity_solver; setting to default: pinv");
+        }
+        solver_->setVelSolver(KDL::VelSolverPinv);
+    }
+
+    KDL::AdaptiveDamping damping = solver_->getDamping();
+    lookupParam("singularity_threshold", damping.threshold, damping.threshold);
+    lookupParam("max_damping", damping.max_damping, damping.max_damping);
+    solver_->setDamping(damping);
+
+    std::string nullspace_objective;
+    double nullspace_gain;
+    lookupParam("nullspace_objective", nullspace_objective, std::string("none"));
+    lookupParam("nullspace_gain", nullspace_gain, 0.5);
+    ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Using null-space objective %s", nullspace_objective.c_str());
+
+    if (nullspace_objective == "joint_distance") {
+        solver_->setNullSpaceObjective(KDL::NullSpaceJointDistance, nullspace_gain);
+    }
+    else if (nullspace_objective == "joint_limits") {
+        solver_->setNullSpaceObjective(KDL::NullSpaceJointLimits, nullspace_gain);
+    }
+    else if (nullspace_objective == "manipulability") {
+        solver_->setNullSpaceObjective(KDL::NullSpaceManipulability, nullspace_gain);
+    }
+    else {
+        if (nullspace_objective != "none") {
+            ROS_WARN_STREAM_NAMED("deterministic_trac_ik", nullspace_objective << " is not a valid nullspace_objective; setting to default: none");
+        }
+        solver_->setNullSpaceObjective(KDL::NullSpaceNone);
+    }
+
+    std::string nlopt_objective;
+    lookupParam("nlopt_objective", nlopt_objective, std::string("sum_squares"));
+    ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Using NLopt objective %s", nlopt_objective.c_str());
+
+    if (nlopt_objective == "l2") {
+        solver_->setNLOptType(NLOPT_IK::L2);
+    }
+    else if (nlopt_objective == "dual_quaternion") {
+        solver_->setNLOptType(NLOPT_IK::DualQuat);
+    }
+    else if (nlopt_objective == "joint") {
+        solver_->setNLOptType(NLOPT_IK::Joint);
+    }
+    else {
+        if (nlopt_objective != "sum_squares") {
+            ROS_WARN_STREAM_NAMED("deterministic_trac_ik", nlopt_objective << " is not a valid nlopt_objective; setting to default: sum_squares");
+        }
+        solver_->setNLOptType(NLOPT_IK::SumSq);
+    }
+
+    std::string nlopt_algorithm;
+    lookupParam("nlopt_algorithm", nlopt_algorithm, std::string("slsqp"));
+    ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Using NLopt algorithm %s", nlopt_algorithm.c_str());
+
+    if (nlopt_algorithm == "lbfgs") {
+        solver_->setNLOptAlgorithm(nlopt::LD_LBFGS);
+    }
+    else if (nlopt_algorithm == "mma") {
+        solver_->setNLOptAlgorithm(nlopt::LD_MMA);
+    }
+    else if (nlopt_algorithm == "ccsaq") {
+        solver_->setNLOptAlgorithm(nlopt::LD_CCSAQ);
+    }
+    else {
+        if (nlopt_algorithm != "slsqp") {
+            ROS_WARN_STREAM_NAMED("deterministic_trac_ik", nlopt_algorithm << " is not a valid nlopt_algorithm; setting to default: slsqp");
+        }
+        solver_->setNLOptAlgorithm(nlopt::LD_SLSQP);
+    }
+
+    double nlopt_xtol;
+    lookupParam("nlopt_xtol", nlopt_xtol, solver_->getNLOptXTolAbs());
+    solver_->setNLOptXTolAbs(nlopt_xtol);
+
+    double coarse_eps;
+    lookupParam("coarse_epsilon", coarse_eps, 0.0);
+    if (coarse_eps > 0.0) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Iterating in single precision down to %f", coarse_eps);
+    }
+    solver_->setCoarseEps(coarse_eps);
+
+    int line_search;
+    lookupParam("line_search_backtracks", line_search, 0);
+    solver_->setLineSearch(line_search);
+
+    bool active_set;
+    lookupParam("active_set_limits", active_set, false);
+    solver_->setActiveSet(active_set);
+
+    double candidate_eps;
+    lookupParam("candidate_epsilon", candidate_eps, 0.0);
+    if (candidate_eps > 0.0) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Refining only improving candidates found to within %f", candidate_eps);
+    }
+    solver_->setCandidateEps(candidate_eps);
+
+    Deterministic_TRAC_IK::StagnationPolicy stagnation;
+    lookupParam("stagnation_patience", stagnation.patience, stagnation.patience);
+    lookupParam("stagnation_threshold", stagnation.threshold, stagnation.threshold);
+    if (stagnation.patience > 0) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Abandoning searches stagnating above %f for %d rounds", stagnation.threshold, stagnation.patience);
+    }
+    solver_->setStagnationPolicy(stagnation);
+
+    Deterministic_TRAC_IK::CostModel cost_model;
+    lookupParam("cost_budget_rate", cost_per_time_, 0.0);
+    lookupParam("cost_fk", cost_model.fk, cost_model.fk);
+    lookupParam("cost_jacobian", cost_model.jacobian, cost_model.jacobian);
+    lookupParam("cost_svd", cost_model.svd, cost_model.svd);
+    if (cost_per_time_ > 0.0) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Bounding searches by a cost of %f per second of timeout", cost_per_time_);
+    }
+    if (!solver_->setCostModel(cost_model)) {
+        ROS_WARN_NAMED("deterministic_trac_ik", "cost_fk, cost_jacobian and cost_svd must be positive; setting to defaults: 1, 1, 2");
+    }
+
+    Deterministic_TRAC_IK::RestartPolicy restart;
+    lookupParam("restart_plateau_window", restart.plateau_window, restart.plateau_window);
+    lookupParam("restart_plateau_improvement", restart.plateau_improvement, restart.plateau_improvement);
+    lookupParam("restart_max_steps", restart.max_steps, restart.max_steps);
+    lookupParam("restart_perturbation", restart.perturbation, restart.perturbation);
+    std::string restart_sampling;
+    lookupParam("restart_sampling", restart_sampling, std::string("resample"));
+    if (restart_sampling == "perturb") {
+        restart.sampling = Deterministic_TRAC_IK::RestartPolicy::Perturb;
+    }
+    else {
+        if (restart_sampling != "resample") {
+            ROS_WARN_STREAM_NAMED("deterministic_trac_ik", restart_sampling << " is not a valid restart_sampling; setting to default: resample");
+        }
+        restart.sampling = Deterministic_TRAC_IK::RestartPolicy::Resample;
+    }
+    solver_->setRestartPolicy(restart);
+
+    std::string reachability_map_file;
+    lookupParam("reachability_map", reachability_map_file, std::string());
+    if (!reachability_map_file.empty()) {
+        auto map = std::make_shared<Deterministic_TRAC_IK::ReachabilityMap>();
+        if (!map->load(reachability_map_file)) {
+            ROS_WARN_NAMED("deterministic_trac_ik", "Ignoring reachability map %s", reachability_map_file.c_str());
+        }
+        else if (map->chainSignature() != Deterministic_TRAC_IK::ChainSignature(chain_)) {
+            ROS_WARN_NAMED("deterministic_trac_ik", "Reachability map %s was built for a different chain; ignoring it", reachability_map_file.c_str());
+        }
+        else {
+            ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Using reachability map %s", reachability_map_file.c_str());
+            solver_->setReachabilityMap(map);
+        }
+    }
+
+    int cache_size;
+    lookupParam("cache_size", cache_size, 0);
+    lookupParam("cache_file", cache_file_, std::string());
+
+    if (cache_size > 0) {
+        double cache_position_resolution;
+        double cache_angle_resolution;
+        lookupParam("cache_position_resolution", cache_position_resolution, 1e-4);
+        lookupParam("cache_angle_resolution", cache_angle_resolution, 1e-3);
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Using IK cache of size %d", cache_size);
+
+        auto cache = std::make_shared<Deterministic_TRAC_IK::IKCache>(
+                cache_size, cache_position_resolution, cache_angle_resolution);
+        if (!cache_file_.empty()) {
+            cache->load(
+                    cache_file_,
+                    Deterministic_TRAC_IK::ChainSignature(chain_),
+                    chain_.getNrOfJoints());
+        }
+        solver_->setCache(cache);
+    }
+
+    std::string query_log_file;
+    int query_log_capacity;
+    lookupParam("query_log_file", query_log_file, std::string());
+    lookupParam("query_log_capacity", query_log_capacity, 100000);
+    if (!query_log_file.empty()) {
+        // recorded last, so that the log records every option affecting
+        // the results
+        Deterministic_TRAC_IK::SolverOptions options = solver_->getSolverOptions();
+        options.compiled_chain = compiled_chain;
+
+        auto log = std::make_shared<Deterministic_TRAC_IK::QueryLog>();
+        if (query_log_capacity <= 0 ||
+            !log->open(
+                    query_log_file,
+                    chain_.getNrOfJoints(),
+                    query_log_capacity,
+                    Deterministic_TRAC_IK::ChainSignature(chain_),
+                    options))
+        {
+            ROS_WARN_NAMED("deterministic_trac_ik", "Not recording queries to %s", query_log_file.c_str());
+        }
+        else {
+            ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Recording queries to %s", query_log_file.c_str());
+            solver_->setQueryLog(log);
+        }
+    }
+
+    std::string telemetry_file;
+    lookupParam("telemetry_file", telemetry_file, std::string());
+    if (!telemetry_file.empty()) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "Writing telemetry to %s", telemetry_file.c_str());
+        telemetry_ = GetGroupTelemetry(node_handle, group_name, telemetry_file);
+    }
 
     active_ = true;
     return true;
 }
 
+Deterministic_TRAC_IKKinematicsPlugin::~Deterministic_TRAC_IKKinematicsPlugin()
+{
+    if (solver_ && solver_->getCache() && !cache_file_.empty()) {
+        const auto& cache = solver_->getCache();
+        ROS_DEBUG_NAMED("deterministic_trac_ik plugin", "IK cache: %lu hits, %lu misses", (unsigned long)cache->hits(), (unsigned long)cache->misses());
+        cache->save(
+                cache_file_,
+                Deterministic_TRAC_IK::ChainSignature(chain_),
+                chain_.getNrOfJoints());
+    }
+}
+
 int Deterministic_TRAC_IKKinematicsPlugin::getKDLSegmentIndex(const std::string &name) const
 {
     int i = 0;
@@ -148,6 +543,21 @@ int Deterministic_TRAC_IKKinematicsPlugin::getKDLSegmentIndex(const std::string
     return -1;
 }
 
+bool Deterministic_TRAC_IKKinematicsPlugin::supportsGroup(
+    const moveit::core::JointModelGroup* jmg,
+    std::string* error_text_out) const
+{
+    // trees are supported when initialized with one tip frame per branch
+    if (tree_solver_ || jmg->isChain()) {
+        return true;
+    }
+
+    if (error_text_out) {
+        *error_text_out = "This plugin only supports chains, or trees given one tip frame per branch";
+    }
+    return false;
+}
+
 bool Deterministic_TRAC_IKKinematicsPlugin::getPositionFK(
     const std::vector<std::string> &link_names,
     const std::vector<double> &joint_angles,
@@ -155,9 +565,11 @@ bool Deterministic_TRAC_IKKinematicsPlugin::getPositionFK(
 {
     assert(active_);
 
+    auto before = std::chrono::steady_clock::now();
+
     poses.resize(link_names.size());
-    if (joint_angles.size() != chain_.getNrOfJoints()) {
-        ROS_ERROR_NAMED("deterministic_trac_ik", "Joint angles vector must have size: %d", chain_.getNrOfJoints());
+    if (joint_angles.size() != joint_names_.size()) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Joint angles vector must have size: %zu", joint_names_.size());
         return false;
     }
 
@@ -166,7 +578,7 @@ bool Deterministic_TRAC_IKKinematicsPlugin::getPositionFK(
     tf::Stamped<tf::Pose> tf_pose;
 
     auto& jnt_pos_in(tmp_in_);
-    for (unsigned int i = 0; i < chain_.getNrOfJoints(); i++) {
+    for (unsigned int i = 0; i < joint_names_.size(); i++) {
         jnt_pos_in(i) = joint_angles[i];
     }
 
@@ -174,8 +586,17 @@ bool Deterministic_TRAC_IKKinematicsPlugin::getPositionFK(
 
     bool valid = true;
     for (unsigned int i = 0; i < poses.size(); i++) {
-        ROS_DEBUG_NAMED("deterministic_trac_ik","End effector index: %d", getKDLSegmentIndex(link_names[i]));
-        if (fk_solver.JntToCart(jnt_pos_in, p_out, getKDLSegmentIndex(link_names[i])) >= 0) {
+        int rc;
+        if (tree_solver_) {
+            rc = tree_solver_->JntToCart(jnt_pos_in, link_names[i], p_out);
+        } else {
+            const int segment = getKDLSegmentIndex(link_names[i]);
+            ROS_DEBUG_NAMED("deterministic_trac_ik","End effector index: %d", segment);
+            // KDL reads a negative index as the whole chain
+            rc = segment < 0 ? -1 : fk_solver.JntToCart(jnt_pos_in, p_out, segment);
+        }
+
+        if (rc >= 0) {
             tf::poseKDLToMsg(p_out, poses[i]);
         } else {
             ROS_ERROR_NAMED("deterministic_trac_ik", "Could not compute FK for %s", link_names[i].c_str());
@@ -183,6 +604,11 @@ bool Deterministic_TRAC_IKKinematicsPlugin::getPositionFK(
         }
     }
 
+    if (telemetry_) {
+        auto after = std::chrono::steady_clock::now();
+        telemetry_->recordFK(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+    }
+
     return valid;
 }
 
@@ -304,12 +730,28 @@ bool Deterministic_TRAC_IKKinematicsPlugin::searchPositionIK(
 
     assert(active_);
 
+    auto before = std::chrono::steady_clock::now();
+
+    if (tree_solver_) {
+        ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Group " << getGroupName() << " has " << tree_solver_->getNrOfTips() << " tip frames; a pose is required for each");
+        error_code.val = error_code.NO_IK_SOLUTION;
+        return false;
+    }
+
     if (ik_seed_state.size() != chain_.getNrOfJoints()) {
         ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Seed state must have size " << chain_.getNrOfJoints() << " instead of size " << ik_seed_state.size());
         error_code.val = error_code.NO_IK_SOLUTION;
         return false;
     }
 
+    if (!consistency_limits.empty() &&
+        consistency_limits.size() != chain_.getNrOfJoints())
+    {
+        ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Consistency limits must be empty or have size " << chain_.getNrOfJoints() << " instead of size " << consistency_limits.size());
+        error_code.val = error_code.NO_IK_SOLUTION;
+        return false;
+    }
+
     KDL::Frame frame;
     tf::poseMsgToKDL(ik_pose, frame);
 
@@ -320,9 +762,59 @@ bool Deterministic_TRAC_IKKinematicsPlugin::searchPositionIK(
         in(z) = ik_seed_state[z];
     }
 
-    solver_->setMaxIterations(timeout * iter_per_time_);
+    KDL::JntArray no_consistency_limits;
+    auto& limits(consistency_limits.empty() ? no_consistency_limits : tmp_consistency_);
 
-    int rc = solver_->CartToJnt(in, frame, out, bounds_);
+    for (unsigned int z = 0; z < consistency_limits.size(); ++z) {
+        limits(z) = consistency_limits[z];
+    }
+
+    // evaluate the callback, e.g. collision checking, inside the search so
+    // that rejected candidates only cost a random restart
+    Deterministic_TRAC_IK::SolutionFilter filter;
+    if (!solution_callback.empty()) {
+        filter = [&](const KDL::JntArray& q) {
+            solution.resize(chain_.getNrOfJoints());
+            for (unsigned int z = 0; z < chain_.getNrOfJoints(); z++) {
+                solution[z] = q(z);
+            }
+
+            solution_callback(ik_pose, solution, error_code);
+            if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS) {
+                ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik","Solution passes callback");
+                return true;
+            } else {
+                ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik","Solution has error code " << error_code);
+                if (telemetry_) {
+                    telemetry_->recordRejection();
+                }
+                return false;
+            }
+        };
+    }
+
+    const int max_iters = timeout * iter_per_time_;
+    solver_->setMaxIterations(max_iters);
+    const double cost_budget = std::max(0.0, timeout * cost_per_time_);
+    solver_->setCostBudget(cost_budget);
+
+    int rc = solver_->CartToJnt(in, frame, out, bounds_, limits, filter);
+
+    if (telemetry_) {
+        auto after = std::chrono::steady_clock::now();
+        const uint64_t duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count();
+        if (cost_budget > 0.0) {
+            telemetry_->recordIK(
+                    rc >= 0, duration_ns,
+                    std::llround(solver_->getLastCost()),
+                    std::llround(cost_budget));
+        } else {
+            telemetry_->recordIK(
+                    rc >= 0, duration_ns,
+                    solver_->getLastIterations(),
+                    std::max(0, max_iters));
+        }
+    }
 
     if (rc < 0) {
         error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
@@ -335,19 +827,136 @@ bool Deterministic_TRAC_IKKinematicsPlugin::searchPositionIK(
         solution[z] = out(z);
     }
 
-    // check for collisions if a callback is provided
-    if (solution_callback.empty()) {
-        return true;
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
+}
+
+bool Deterministic_TRAC_IKKinematicsPlugin::searchPositionIK(
+    const std::vector<geometry_msgs::Pose> &ik_poses,
+    const std::vector<double> &ik_seed_state,
+    double timeout,
+    const std::vector<double> &consistency_limits,
+    std::vector<double> &solution,
+    const IKCallbackFn &solution_callback,
+    moveit_msgs::MoveItErrorCodes &error_code,
+    const kinematics::KinematicsQueryOptions &options,
+    const moveit::core::RobotState* context_state) const
+{
+    assert(active_);
+
+    if (!tree_solver_) {
+        if (ik_poses.size() != 1) {
+            ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Expected 1 pose instead of " << ik_poses.size());
+            error_code.val = error_code.NO_IK_SOLUTION;
+            return false;
+        }
+
+        return searchPositionIK(
+                ik_poses[0],
+                ik_seed_state,
+                timeout,
+                solution,
+                solution_callback,
+                error_code,
+                consistency_limits,
+                options);
     }
 
-    solution_callback(ik_pose, solution, error_code);
-    if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS) {
-        ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik","Solution passes callback");
-        return true;
+    auto before = std::chrono::steady_clock::now();
+
+    const unsigned int num_joints = tree_solver_->getNrOfJoints();
+
+    if (ik_poses.size() != tree_solver_->getNrOfTips()) {
+        ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Expected " << tree_solver_->getNrOfTips() << " poses instead of " << ik_poses.size());
+        error_code.val = error_code.NO_IK_SOLUTION;
+        return false;
+    }
+
+    if (ik_seed_state.size() != num_joints) {
+        ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Seed state must have size " << num_joints << " instead of size " << ik_seed_state.size());
+        error_code.val = error_code.NO_IK_SOLUTION;
+        return false;
+    }
+
+    if (!consistency_limits.empty() &&
+        consistency_limits.size() != num_joints)
+    {
+        ROS_ERROR_STREAM_NAMED("deterministic_trac_ik", "Consistency limits must be empty or have size " << num_joints << " instead of size " << consistency_limits.size());
+        error_code.val = error_code.NO_IK_SOLUTION;
+        return false;
+    }
+
+    std::vector<KDL::Frame> frames(ik_poses.size());
+    for (size_t k = 0; k < ik_poses.size(); ++k) {
+        tf::poseMsgToKDL(ik_poses[k], frames[k]);
+    }
+
+    auto& in(tmp_in_);
+    auto& out(tmp_out_);
+
+    for (unsigned int z = 0; z < num_joints; ++z) {
+        in(z) = ik_seed_state[z];
+    }
+
+    if (consistency_limits.empty()) {
+        tree_solver_->resetJointLimits();
     } else {
-        ROS_DEBUG_STREAM_NAMED("deterministic_trac_ik","Solution has error code " << error_code);
+        KDL::JntArray window_min(num_joints);
+        KDL::JntArray window_max(num_joints);
+        for (unsigned int z = 0; z < num_joints; ++z) {
+            window_min(z) = in(z) - std::abs(consistency_limits[z]);
+            window_max(z) = in(z) + std::abs(consistency_limits[z]);
+        }
+        tree_solver_->setJointLimits(window_min, window_max);
+    }
+
+    Deterministic_TRAC_IK::SolutionFilter filter;
+    if (!solution_callback.empty()) {
+        filter = [&](const KDL::JntArray& q) {
+            solution.resize(num_joints);
+            for (unsigned int z = 0; z < num_joints; z++) {
+                solution[z] = q(z);
+            }
+
+            solution_callback(ik_poses[0], solution, error_code);
+            if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS) {
+                return true;
+            }
+            if (telemetry_) {
+                telemetry_->recordRejection();
+            }
+            return false;
+        };
+    }
+
+    const int max_iters = timeout * iter_per_time_;
+    tree_solver_->setMaxIterations(max_iters);
+
+    const std::vector<KDL::Twist> bounds(ik_poses.size(), bounds_);
+    int rc = tree_solver_->CartToJnt(in, frames, out, bounds, filter);
+
+    if (telemetry_) {
+        auto after = std::chrono::steady_clock::now();
+        const uint64_t duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count();
+        telemetry_->recordIK(
+                rc >= 0, duration_ns,
+                tree_solver_->getLastIterations(),
+                std::max(0, max_iters));
+    }
+
+    if (rc < 0) {
+        error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
         return false;
     }
+
+    solution.resize(num_joints);
+
+    for (unsigned int z = 0; z < num_joints; z++) {
+        solution[z] = out(z);
+    }
+
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
 }
 
 } // namespace deterministic_trac_ik_kinematics_plugin
@@ -32,6 +32,8 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <kdl/chain.hpp>
 #include <kdl/jntarray.hpp>
 #include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/telemetry.hpp>
+#include <deterministic_trac_ik/tree_ik_solver.hpp>
 
 namespace deterministic_trac_ik_kinematics_plugin {
 
@@ -46,9 +48,12 @@ public:
         active_(false),
         position_ik_(false),
         solve_type_(Deterministic_TRAC_IK::Speed),
-        iter_per_time_(1500 / 0.005)
+        iter_per_time_(1500 / 0.005),
+        cost_per_time_(0.0)
     { }
 
+    ~Deterministic_TRAC_IKKinematicsPlugin();
+
     /**
      * @brief Given a desired pose of the end-effector, compute the joint angles to reach it
      * @param ik_pose the desired pose of the link
@@ -153,6 +158,26 @@ public:
         const std::vector<double> &consistency_limits,
         const kinematics::KinematicsQueryOptions &options) const;
 
+    /**
+     * @brief Given the desired poses of all tip frames, search for the joint angles required to reach them.
+     * With several tip frames, the poses are solved jointly by a tree solver; with one, this is the same as
+     * the single-pose overload.
+     * @param ik_poses the desired poses of the tip frames, in the order of getTipFrames()
+     * @param ik_seed_state an initial guess solution for the inverse kinematics
+     * @return True if a valid solution was found, false otherwise
+     */
+    bool searchPositionIK(
+        const std::vector<geometry_msgs::Pose> &ik_poses,
+        const std::vector<double> &ik_seed_state,
+        double timeout,
+        const std::vector<double> &consistency_limits,
+        std::vector<double> &solution,
+        const IKCallbackFn &solution_callback,
+        moveit_msgs::MoveItErrorCodes &error_code,
+        const kinematics::KinematicsQueryOptions &options =
+                kinematics::KinematicsQueryOptions(),
+        const moveit::core::RobotState* context_state = nullptr) const override;
+
     /**
      * @brief Given a set of joint angles and a set of links, compute their pose
      *
@@ -187,9 +212,24 @@ private:
 
     std::unique_ptr<Deterministic_TRAC_IK::Deterministic_TRAC_IK> solver_;
 
+    // used instead of solver_ for groups with several tip frames
+    std::unique_ptr<Deterministic_TRAC_IK::TreeIkSolver> tree_solver_;
+
     double iter_per_time_;
 
-    mutable KDL::JntArray tmp_in_, tmp_out_;
+    // cost budget of the search per second of timeout, 0 if searches are
+    // bounded by iterations
+    double cost_per_time_;
+
+    // snapshot file used to warm-start the IK cache, if enabled
+    std::string cache_file_;
+
+    // aggregate statistics of the queries served, if enabled, and the file
+    // they are written to
+    // shared by the instances of the group in this process
+    std::shared_ptr<Deterministic_TRAC_IK::IKTelemetry> telemetry_;
+
+    mutable KDL::JntArray tmp_in_, tmp_out_, tmp_consistency_;
 
     const std::vector<std::string>& getJointNames() const override {
         return joint_names_;
@@ -206,6 +246,10 @@ private:
         const std::vector<std::string>& tip_frames,
         double search_discretization) override;
 
+    bool supportsGroup(
+        const moveit::core::JointModelGroup* jmg,
+        std::string* error_text_out = nullptr) const override;
+
     int getKDLSegmentIndex(const std::string &name) const;
 };
 
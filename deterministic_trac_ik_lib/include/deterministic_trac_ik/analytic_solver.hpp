@@ -0,0 +1,116 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_ANALYTIC_SOLVER_HPP
+#define DETERMINISTIC_TRAC_IK_ANALYTIC_SOLVER_HPP
+
+// standard includes
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// system includes
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// A closed-form inverse kinematics solver for one specific chain, e.g. a
+/// wrapper around IKFast-generated code.
+class AnalyticSolver
+{
+public:
+
+    virtual ~AnalyticSolver() { }
+
+    /// Append every solution branch that reaches \p p_in to \p solutions.
+    /// Solutions need not respect joint limits or be wrapped near any seed;
+    /// the caller normalizes and validates them. Return false if the pose is
+    /// not handled, e.g. it is unreachable.
+    virtual bool CartToJnt(
+        const KDL::Frame& p_in,
+        std::vector<KDL::JntArray>& solutions) = 0;
+};
+
+typedef std::function<std::shared_ptr<AnalyticSolver>(const KDL::Chain&)> AnalyticSolverFactory;
+
+/// Return a hash of the kinematic structure of \p chain: the type, axis, and
+/// origin of each joint and the tip frame of each segment, rounded to 1e-6.
+/// Fixed segments are fused first (see FuseFixedSegments()) and joints only
+/// count as revolute or prismatic, so a chain and its CompiledChain share a
+/// signature. Chains with the same signature share analytic solvers.
+uint64_t ChainSignature(const KDL::Chain& chain);
+
+/// Process-wide table of analytic solver factories, keyed by chain signature.
+class AnalyticSolverRegistry
+{
+public:
+
+    /// Name of the function that shared libraries loaded with load() must
+    /// export with C linkage, as
+    /// void deterministic_trac_ik_register_solvers(AnalyticSolverRegistry&).
+    static const char* RegisterSymbol;
+
+    static AnalyticSolverRegistry& instance();
+
+    void add(uint64_t signature, const AnalyticSolverFactory& factory);
+    void add(const KDL::Chain& chain, const AnalyticSolverFactory& factory)
+    {
+        add(ChainSignature(chain), factory);
+    }
+
+    /// Return a new solver for \p chain, or an empty pointer if none is
+    /// registered for its signature.
+    std::shared_ptr<AnalyticSolver> create(const KDL::Chain& chain) const;
+
+    /// Open the shared library at \p path and call its registration
+    /// function. The library stays loaded for the lifetime of the registry.
+    bool load(const std::string& path);
+
+private:
+
+    AnalyticSolverRegistry() { }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, AnalyticSolverFactory> factories_;
+
+    // handles of loaded libraries; never closed since solvers created by
+    // them may outlive the registry
+    std::vector<void*> libraries_;
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
@@ -0,0 +1,118 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef KDLCHAINFKJACSOLVER_HPP
+#define KDLCHAINFKJACSOLVER_HPP
+
+// standard includes
+#include <vector>
+
+// system includes
+#include <Eigen/Core>
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jacobian.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace KDL {
+
+/// Computes the tip frame and the Jacobian of a chain in a single traversal.
+///
+/// The Jacobian matches that of KDL::ChainJntToJacSolver: it is expressed in
+/// the base frame of the chain with its reference point at the tip.
+class ChainFkJacSolver
+{
+public:
+
+    explicit ChainFkJacSolver(const Chain& chain);
+
+    /// Return 0 on success and a negative value if the sizes of \p q or
+    /// \p jac do not match the chain.
+    int JntToCartJac(const JntArray& q, Frame& p_out, Jacobian& jac);
+
+private:
+
+    const Chain& chain_;
+
+    // origin of each joint's segment tip, the reference point of its column
+    // until the tip frame is known
+    std::vector<Vector> ref_points_;
+};
+
+/// Computes the tip frame and the Jacobian of a chain in a single traversal,
+/// like ChainFkJacSolver, with all arithmetic in \p Scalar. Fixed segments
+/// are folded into the transforms between joints at construction, and each
+/// joint becomes a screw about its axis. Instantiated for float and double.
+template <typename Scalar>
+class ChainFkJacKernel
+{
+public:
+
+    typedef Eigen::Matrix<Scalar, 6, Eigen::Dynamic> Jacobian;
+
+    explicit ChainFkJacKernel(const Chain& chain);
+
+    unsigned int getNrOfJoints() const { return links_.size(); }
+
+    /// Return 0 on success and a negative value if the sizes of \p q or
+    /// \p jac do not match the chain. \p p_out is converted to double.
+    int JntToCartJac(const JntArray& q, Frame& p_out, Jacobian& jac);
+
+private:
+
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+
+    struct Link
+    {
+        // from the moved frame of the previous joint to the base of this
+        // joint's segment
+        Matrix3 R;
+        Vector3 p;
+
+        // the joint's axis and a point on it, in its segment's base frame
+        Vector3 axis;
+        Vector3 origin;
+        bool rotational;
+    };
+
+    std::vector<Link> links_;
+
+    // from the moved frame of the last joint to the tip of the chain
+    Matrix3 tail_R_;
+    Vector3 tail_p_;
+
+    // a point on each joint's axis, in the base frame
+    std::vector<Vector3> ref_points_;
+};
+
+} // namespace KDL
+
+#endif
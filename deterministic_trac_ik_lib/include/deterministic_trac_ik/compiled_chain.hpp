@@ -0,0 +1,127 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_COMPILED_CHAIN_HPP
+#define DETERMINISTIC_TRAC_IK_COMPILED_CHAIN_HPP
+
+// standard includes
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// system includes
+#include <kdl/chain.hpp>
+#include <kdl/jntarray.hpp>
+
+// project includes
+#include <deterministic_trac_ik/kdl_tl.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// Return \p chain with every run of consecutive fixed segments folded into
+/// the segment before it, or into one leading fixed segment. The frame at the
+/// tip of every movable segment and of the chain is unchanged; each folded
+/// segment takes the name of the last segment of its run.
+KDL::Chain FuseFixedSegments(const KDL::Chain& chain);
+
+/// A chain with its fixed segments fused and its joints reduced to
+/// KDL::Joint::RotAxis and KDL::Joint::TransAxis, together with the names and
+/// limits of its joints, in a compact binary form that is loaded without
+/// parsing a robot description. The links of the chain are named after its
+/// segments.
+///
+/// The chain built by the constructor is identical to the one loaded back
+/// from its file, so solvers behave the same whether or not a compiled chain
+/// came from a cache.
+class CompiledChain
+{
+public:
+
+    CompiledChain();
+
+    CompiledChain(
+        const KDL::Chain& chain,
+        const std::vector<std::string>& joint_names,
+        const KDL::JntArray& q_min,
+        const KDL::JntArray& q_max);
+
+    /// Write the chain to \p path, tagged with \p source_key, e.g. a hash of
+    /// the robot description it was extracted from. The file is replaced
+    /// atomically.
+    bool save(const std::string& path, uint64_t source_key) const;
+
+    /// Map the file at \p path, written by save(), and read the chain from
+    /// it. Fail if the file is missing, invalid, or tagged with a key other
+    /// than \p source_key.
+    bool load(const std::string& path, uint64_t source_key);
+
+    bool valid() const { return valid_; }
+
+    const KDL::Chain& chain() const { return chain_; }
+    const std::vector<std::string>& linkNames() const { return link_names_; }
+    const std::vector<std::string>& jointNames() const { return joint_names_; }
+    const KDL::JntArray& lowerLimits() const { return q_min_; }
+    const KDL::JntArray& upperLimits() const { return q_max_; }
+    const std::vector<KDL::BasicJointType>& jointTypes() const { return joint_types_; }
+
+private:
+
+    struct Header;
+    struct SegmentRecord;
+
+    // a segment as given to the KDL::Segment constructor
+    struct SegmentData
+    {
+        std::string name;
+        std::string joint_name;
+        KDL::Joint::JointType type; // None, RotAxis or TransAxis
+        KDL::Vector origin;
+        KDL::Vector axis;
+        KDL::Frame f_tip;
+    };
+
+    bool valid_;
+
+    std::vector<SegmentData> segments_;
+
+    KDL::Chain chain_;
+    std::vector<std::string> link_names_;
+    std::vector<std::string> joint_names_;
+    KDL::JntArray q_min_;
+    KDL::JntArray q_max_;
+    std::vector<KDL::BasicJointType> joint_types_;
+
+    // Build chain_ and joint_types_ from segments_ and the limits.
+    void buildChain();
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
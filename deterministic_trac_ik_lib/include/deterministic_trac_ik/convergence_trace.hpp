@@ -0,0 +1,107 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_CONVERGENCE_TRACE_HPP
+#define DETERMINISTIC_TRAC_IK_CONVERGENCE_TRACE_HPP
+
+// standard includes
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Deterministic_TRAC_IK {
+
+/// One iteration of a sub-solver: a step of the pseudo-inverse solver, or an
+/// objective evaluation of the NLopt solver.
+struct TraceEntry
+{
+    uint64_t query;     // CartToJnt calls traced so far, including this one
+    const char* solver; // IterativeIkSolver::name()
+    uint64_t step;      // iterations of the solver since its target was set
+    double residual;    // norm of the twist error outside of the bounds
+    bool restarted;     // the first iteration after a restart of the solver
+    bool clamped;       // a joint was held at one of its limits
+};
+
+/// A fixed-size ring of the most recent iterations of the sub-solvers of a
+/// Deterministic_TRAC_IK, for studying how their residuals evolve. The
+/// solvers only record iterations when the library is built with
+/// DETERMINISTIC_TRAC_IK_TRACE defined; otherwise the trace stays empty and
+/// costs nothing. A trace is not thread-safe and must not be shared by
+/// solvers running on different threads.
+class ConvergenceTrace
+{
+public:
+
+    explicit ConvergenceTrace(size_t capacity = 65536);
+
+    size_t capacity() const { return entries_.size(); }
+
+    /// Return the number of entries held, at most capacity().
+    size_t size() const;
+
+    void beginQuery() { ++queries_; }
+
+    void record(
+        const char* solver,
+        uint64_t step,
+        double residual,
+        bool restarted,
+        bool clamped);
+
+    /// Return the entries held, oldest first.
+    std::vector<TraceEntry> entries() const;
+
+    void clear();
+
+    /// Write the entries held, oldest first, as CSV with a header row.
+    void writeCSV(std::ostream& os) const;
+    bool saveCSV(const std::string& path) const;
+
+private:
+
+    std::vector<TraceEntry> entries_;
+    uint64_t count_; // entries recorded since the last clear()
+    uint64_t queries_;
+};
+
+} // namespace Deterministic_TRAC_IK
+
+/// Record an iteration in \p trace, a possibly empty pointer to a
+/// ConvergenceTrace, if tracing is compiled in.
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+#define DETERMINISTIC_TRAC_IK_TRACE_STEP(trace, ...) \
+    do { if (trace) { (trace)->record(__VA_ARGS__); } } while (0)
+#else
+#define DETERMINISTIC_TRAC_IK_TRACE_STEP(trace, ...) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_COST_MODEL_HPP
+#define DETERMINISTIC_TRAC_IK_COST_MODEL_HPP
+
+// standard includes
+#include <cstdint>
+
+namespace Deterministic_TRAC_IK {
+
+/// Evaluations performed by an iterative solver, by kind.
+struct WorkCounters
+{
+    WorkCounters() : fk(0), jacobian(0), svd(0) { }
+
+    uint64_t fk;        // forward kinematics of the chain
+    uint64_t jacobian;  // Jacobians of the chain
+    uint64_t svd;       // singular value decompositions of a Jacobian
+
+    WorkCounters& operator+=(const WorkCounters& other)
+    {
+        fk += other.fk;
+        jacobian += other.jacobian;
+        svd += other.svd;
+        return *this;
+    }
+
+    WorkCounters operator-(const WorkCounters& other) const
+    {
+        WorkCounters diff;
+        diff.fk = fk - other.fk;
+        diff.jacobian = jacobian - other.jacobian;
+        diff.svd = svd - other.svd;
+        return diff;
+    }
+};
+
+/// The cost charged for each kind of evaluation, per joint of the chain.
+/// Every kind of evaluation grows about linearly with the number of joints,
+/// so a budget in these units maps onto about the same time for chains of
+/// any length. The defaults are a rough starting point; calibrate them by
+/// timing a search on the target machine.
+struct CostModel
+{
+    CostModel() : fk(1.0), jacobian(1.0), svd(2.0) { }
+
+    double fk;
+    double jacobian;
+    double svd;
+
+    /// Return whether every weight is positive, so that any evaluation
+    /// increases the cost.
+    bool valid() const { return fk > 0.0 && jacobian > 0.0 && svd > 0.0; }
+
+    double cost(const WorkCounters& work, unsigned int num_joints) const
+    {
+        return num_joints * (fk * work.fk + jacobian * work.jacobian + svd * work.svd);
+    }
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
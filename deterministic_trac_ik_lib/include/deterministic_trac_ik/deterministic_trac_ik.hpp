@@ -32,13 +32,22 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DETERMINISTIC_TRAC_IK_HPP
 
 // standard includes
+#include <functional>
+#include <memory>
 #include <random>
 
 // system includes
+#include <kdl/chainfksolverpos_recursive.hpp>
 #include <kdl/chainjnttojacsolver.hpp>
 
 // project includes
+#include <deterministic_trac_ik/analytic_solver.hpp>
+#include <deterministic_trac_ik/cost_model.hpp>
+#include <deterministic_trac_ik/ik_cache.hpp>
+#include <deterministic_trac_ik/iterative_ik_solver.hpp>
 #include <deterministic_trac_ik/nlopt_ik.hpp>
+#include <deterministic_trac_ik/query_log.hpp>
+#include <deterministic_trac_ik/reachability_map.hpp>
 
 namespace Deterministic_TRAC_IK {
 
@@ -50,6 +59,35 @@ enum SolveType
     Manip2
 };
 
+/// Negative values returned by CartToJnt
+enum ErrorCode
+{
+    NoSolution = -3,    // no solution found within the iteration budget
+    Unreachable = -4,   // the reachability map rules out the target pose
+    Stagnated = -5      // the search was abandoned by the StagnationPolicy
+};
+
+/// When to abandon a search whose solvers have stopped making progress.
+/// After each round of a solver, its best residual (the norm of the twist
+/// error outside of the bounds) counts as improved if it dropped by more than
+/// \p min_improvement relative to the last improvement. The search returns
+/// Stagnated once every enabled solver has gone \p patience of its rounds
+/// without improving while its best residual is still above \p threshold.
+/// The decision depends only on iteration counts, never on time.
+struct StagnationPolicy
+{
+    StagnationPolicy() : patience(0), threshold(1e-2), min_improvement(1e-2) { }
+
+    int patience;           // 0 disables the policy
+    double threshold;
+    double min_improvement;
+};
+
+/// Predicate evaluated on each candidate solution found during a search.
+/// Returning false rejects the candidate; the search then continues from a
+/// new random seed within the same iteration budget.
+typedef std::function<bool(const KDL::JntArray&)> SolutionFilter;
+
 class Deterministic_TRAC_IK
 {
 public:
@@ -72,15 +110,205 @@ public:
     const KDL::JntArray& getLowerLimits() const { return joint_min_; }
     const KDL::JntArray& getUpperLimits() const { return joint_max_; }
 
-    /// Return a negative value if an error was encountered.
+    /// Return a negative ErrorCode if an error was encountered.
     int CartToJnt(
         const KDL::JntArray &q_init,
         const KDL::Frame &p_in,
         KDL::JntArray &q_out,
         const KDL::Twist& bounds = KDL::Twist::Zero());
 
+    /// Return a negative ErrorCode if an error was encountered.
+    ///
+    /// If non-empty, \p consistency_limits restricts the search for each
+    /// joint to within the given distance of its value in \p q_init. If
+    /// given, \p filter must accept a candidate for it to be returned.
+    int CartToJnt(
+        const KDL::JntArray &q_init,
+        const KDL::Frame &p_in,
+        KDL::JntArray &q_out,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits,
+        const SolutionFilter& filter = SolutionFilter());
+
     void SetSolveType(SolveType _type) { solve_type_ = _type; }
 
+    /// Select the velocity solver used by the pseudo-inverse sub-solver and
+    /// the damping it applies near singularities. Selecting a solver resets
+    /// the damping to KDL::DefaultDamping(type).
+    void setVelSolver(KDL::VelSolverType type) { ik_solver_.setVelSolver(type); }
+    KDL::VelSolverType getVelSolver() const { return ik_solver_.velSolver(); }
+    void setDamping(const KDL::AdaptiveDamping& damping) { ik_solver_.setDamping(damping); }
+    const KDL::AdaptiveDamping& getDamping() const { return ik_solver_.damping(); }
+
+    /// Descend \p objective in the null space of the pseudo-inverse
+    /// sub-solver's steps. With NullSpaceJointDistance, Distance mode returns
+    /// the first solution found by that sub-solver instead of sampling until
+    /// the iteration budget is exhausted.
+    void setNullSpaceObjective(KDL::NullSpaceObjective objective, double gain = 0.5)
+    {
+        ik_solver_.setNullSpaceObjective(objective, gain);
+    }
+    KDL::NullSpaceObjective getNullSpaceObjective() const { return ik_solver_.nullSpaceObjective(); }
+    double getNullSpaceGain() const { return ik_solver_.nullSpaceGain(); }
+
+    /// Select the objective, algorithm and joint tolerance of the NLopt
+    /// sub-solver. Defaults to SumSq with LD_SLSQP and the epsilon of float.
+    void setNLOptType(NLOPT_IK::OptType type) { nl_solver_.setOptType(type); }
+    NLOPT_IK::OptType getNLOptType() const { return nl_solver_.optType(); }
+    void setNLOptAlgorithm(nlopt::algorithm algorithm) { nl_solver_.setAlgorithm(algorithm); }
+    nlopt::algorithm getNLOptAlgorithm() const { return nl_solver_.algorithm(); }
+    void setNLOptXTolAbs(double xtol) { nl_solver_.setXTolAbs(xtol); }
+    double getNLOptXTolAbs() const { return nl_solver_.xtolAbs(); }
+
+    /// Let the pseudo-inverse sub-solver iterate in single precision until
+    /// its residual falls to \p coarse_eps, and only refine in double
+    /// precision from there. Disabled (0) by default.
+    void setCoarseEps(double coarse_eps) { ik_solver_.setCoarseEps(coarse_eps); }
+    double getCoarseEps() const { return ik_solver_.coarseEps(); }
+
+    /// Let the pseudo-inverse sub-solver halve a step, up to \p
+    /// max_backtracks times, while it increases the residual, and restart
+    /// when none of them improves it. Disabled (0) by default.
+    void setLineSearch(int max_backtracks) { ik_solver_.setLineSearch(max_backtracks); }
+    int getLineSearch() const { return ik_solver_.lineSearch(); }
+
+    /// Let the pseudo-inverse sub-solver drop joints resting on a limit from
+    /// the steps that would push them into it. Disabled by default.
+    void setActiveSet(bool enabled) { ik_solver_.setActiveSet(enabled); }
+    bool getActiveSet() const { return ik_solver_.activeSet(); }
+
+    /// In Distance and Manipulation modes, let the sub-solvers report
+    /// candidates once their error falls to \p candidate_eps. Only a
+    /// candidate that scores better than every solution found so far is
+    /// refined to the final tolerance, by the sub-solver that found it; the
+    /// others are discarded at once. Disabled (0) by default.
+    void setCandidateEps(double candidate_eps) { candidate_eps_ = candidate_eps; }
+    double getCandidateEps() const { return candidate_eps_; }
+
+    /// Return Stagnated instead of exhausting the iteration budget on
+    /// targets that the solvers stop approaching. Disabled by default.
+    void setStagnationPolicy(const StagnationPolicy& policy) { stagnation_ = policy; }
+    const StagnationPolicy& getStagnationPolicy() const { return stagnation_; }
+
+    /// Set when each sub-solver, including those added later, restarts on
+    /// its own within a search. By default the pseudo-inverse sub-solver
+    /// restarts only when its steps stall, and the NLopt sub-solver never.
+    void setRestartPolicy(const RestartPolicy& policy);
+    const RestartPolicy& getRestartPolicy() const { return restart_policy_; }
+
+    /// Return the restarts of all sub-solvers since the last reset.
+    RestartCounters getRestartCounters() const;
+    void resetRestartCounters();
+
+    /// If \p enabled, reseed the random number generators of this object and
+    /// of its solvers at the start of each search from a hash of the query
+    /// (seed configuration, target frame, bounds and consistency limits) and
+    /// \p salt, so that each result depends only on its query rather than on
+    /// the calls this object handled before. Disabled by default.
+    void setPerQuerySeeding(bool enabled, uint64_t salt = 0)
+    {
+        per_query_seeding_ = enabled;
+        seed_salt_ = salt;
+    }
+    bool getPerQuerySeeding() const { return per_query_seeding_; }
+
+    /// Memoize the results of CartToJnt in \p cache, which may be shared
+    /// with other solvers for the same chain. A cached solution is returned
+    /// only if it still reaches the requested pose within the tolerances of
+    /// the query. Queries with a solution filter bypass the cache. Pass an
+    /// empty pointer to disable caching.
+    void setCache(const std::shared_ptr<IKCache>& cache) { cache_ = cache; }
+    const std::shared_ptr<IKCache>& getCache() const { return cache_; }
+
+    /// Reject targets outside \p map with Unreachable before searching. The
+    /// map must have been built for this chain. Pass an empty pointer to
+    /// disable the check.
+    void setReachabilityMap(const std::shared_ptr<const ReachabilityMap>& map) { reachability_map_ = map; }
+    const std::shared_ptr<const ReachabilityMap>& getReachabilityMap() const { return reachability_map_; }
+
+    /// Record each call of CartToJnt, with its result and duration, in \p
+    /// log, which must have been opened for this chain. The records can be
+    /// replayed offline to reproduce or benchmark production queries. Pass an
+    /// empty pointer to disable recording.
+    void setQueryLog(const std::shared_ptr<QueryLog>& log) { query_log_ = log; }
+    const std::shared_ptr<QueryLog>& getQueryLog() const { return query_log_; }
+
+    /// Return the options to open a QueryLog with, i.e. the options set by
+    /// the setters of this class that are not recorded with each query, and
+    /// which of the cache, reachability map and analytic solver are in use.
+    /// SolverOptions::compiled_chain is left to the caller.
+    SolverOptions getSolverOptions() const;
+
+    /// Apply \p options, e.g. those a query log was recorded with. The
+    /// external components and the compiled chain flag are ignored.
+    void setSolverOptions(const SolverOptions& options);
+
+    /// Record the iterations of each sub-solver, including those added
+    /// later, in \p trace. Iterations are only recorded if the library was
+    /// built with DETERMINISTIC_TRAC_IK_TRACE. Pass an empty pointer to stop
+    /// recording.
+    void setTrace(const std::shared_ptr<ConvergenceTrace>& trace);
+    const std::shared_ptr<ConvergenceTrace>& getTrace() const { return trace_; }
+
+    /// Return the number of numeric solver iterations spent by the last call
+    /// of CartToJnt, summed over the solvers of the portfolio in the same
+    /// units as setMaxIterations(). Solvers take turns of 50 iterations, so
+    /// this is a multiple of 50.
+    unsigned int getLastIterations() const { return iterations_; }
+
+    /// Set the cost charged for each kind of evaluation performed by the
+    /// sub-solvers under a cost budget. Return false, and keep the current
+    /// model, if any of its weights is not positive.
+    bool setCostModel(const CostModel& model);
+    const CostModel& getCostModel() const { return cost_model_; }
+
+    /// Bound each search by the cost, under the cost model, of the
+    /// evaluations its sub-solvers perform rather than by the maximum number
+    /// of iterations. Unlike iterations, the cost tracks the time a search
+    /// takes across solvers and their options, and unlike a timeout, the
+    /// result does not depend on the load of the machine. A solver that does
+    /// not count its evaluations is charged one forward kinematics
+    /// evaluation per iteration. The maximum number of iterations still
+    /// bounds each search. Pass 0 to bound searches by the maximum number of
+    /// iterations alone.
+    void setCostBudget(double budget) { cost_budget_ = budget; }
+    double getCostBudget() const { return cost_budget_; }
+
+    /// Return the cost, under the cost model, of the evaluations performed by
+    /// the last call of CartToJnt.
+    double getLastCost() const { return cost_; }
+
+    /// Indices of the built-in solvers in the solver portfolio.
+    enum SolverIndex {
+        KDLSolver = 0,
+        NLOptSolver = 1
+    };
+
+    /// \name Solver Portfolio
+    /// CartToJnt interleaves the enabled solvers round-robin, in order of
+    /// addition, for a fixed number of iterations each.
+    ///@{
+
+    /// Append \p solver to the portfolio and return its index. The solver
+    /// must be for the same chain and joint limits as this object.
+    size_t addSolver(const std::shared_ptr<IterativeIkSolver>& solver);
+
+    size_t getNrOfSolvers() const { return solvers_.size(); }
+    IterativeIkSolver& getSolver(size_t i) { return *solvers_[i].solver; }
+
+    /// Exclude, or include again, the \p i'th solver from the search.
+    void setSolverEnabled(size_t i, bool enabled) { solvers_[i].enabled = enabled; }
+    bool isSolverEnabled(size_t i) const { return solvers_[i].enabled; }
+    ///@}
+
+    /// Try \p solver before the numeric solvers. In Speed mode, its first
+    /// valid solution is returned; in other modes, the best of all its valid
+    /// branches is returned. The numeric solvers run only if it yields no
+    /// valid solution. Defaults to the solver registered for this chain in
+    /// AnalyticSolverRegistry, if any. Pass an empty pointer to disable.
+    void setAnalyticSolver(const std::shared_ptr<AnalyticSolver>& solver) { analytic_solver_ = solver; }
+    const std::shared_ptr<AnalyticSolver>& getAnalyticSolver() const { return analytic_solver_; }
+
 private:
 
     KDL::Chain chain_;
@@ -88,28 +316,162 @@ private:
     KDL::JntArray joint_max_;
     std::vector<KDL::BasicJointType> joint_types_;
 
+    // joint limits used by the current search; narrower than the above when
+    // consistency limits are given
+    KDL::JntArray search_min_;
+    KDL::JntArray search_max_;
+    std::vector<KDL::BasicJointType> search_types_;
+    bool consistency_limited_;
+
     std::default_random_engine rng_;
+    bool per_query_seeding_;
+    uint64_t seed_salt_;
 
     KDL::ChainJntToJacSolver jac_solver_;
+    KDL::ChainFkSolverPos_recursive fk_solver_;
 
     NLOPT_IK::NLOPT_IK nl_solver_;
     KDL::ChainIkSolverPos_TL ik_solver_;
 
+    struct PortfolioEntry
+    {
+        IterativeIkSolver* solver;
+        std::shared_ptr<IterativeIkSolver> owner; // empty for built-in solvers
+        bool enabled;
+        double eps; // final tolerance, saved while a search loosens it
+        bool refining; // whether it is converging a candidate to eps
+        uint64_t restarts; // restarts of the solver when refinement began
+    };
+
+    std::vector<PortfolioEntry> solvers_;
+
+    StagnationPolicy stagnation_;
+
+    RestartPolicy restart_policy_;
+
+    // per solver: best residual at its last improvement and the number of
+    // its rounds since then
+    std::vector<double> stagnation_best_;
+    std::vector<int> stagnation_rounds_;
+
     KDL::Twist bounds_;
     double eps_;
+    double candidate_eps_;
     SolveType solve_type_;
     int max_iters_;
 
+    // iterations spent by the current query
+    unsigned int iterations_;
+
+    CostModel cost_model_;
+    double cost_budget_;
+
+    // cost of the current query, and the evaluations of each solver already
+    // charged to it
+    double cost_;
+    std::vector<WorkCounters> work_charged_;
+
     std::vector<KDL::JntArray> solutions_;
     std::vector<std::pair<double, size_t>> errors_;
 
+    // candidates rejected by the solution filter, or not worth refining,
+    // during the current search
+    std::vector<KDL::JntArray> rejected_;
+
     KDL::JntArray seed_;
 
+    std::shared_ptr<IKCache> cache_;
+
+    std::shared_ptr<const ReachabilityMap> reachability_map_;
+
+    std::shared_ptr<AnalyticSolver> analytic_solver_;
+    std::vector<KDL::JntArray> analytic_solutions_;
+
+    std::shared_ptr<QueryLog> query_log_;
+
+    std::shared_ptr<ConvergenceTrace> trace_;
+
+    int solve_query(
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        KDL::JntArray& q_out,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits,
+        const SolutionFilter& filter);
+
+    void record_query(
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        const KDL::JntArray& q_out,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits,
+        const SolutionFilter& filter,
+        int rc,
+        uint64_t duration_ns);
+
+    int search(
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        KDL::JntArray& q_out,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits,
+        const SolutionFilter& filter);
+
+    int searchAnalytic(
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        KDL::JntArray& q_out,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits,
+        const SolutionFilter& filter);
+
+    // Update the stagnation state of the i'th solver after one of its
+    // rounds and return whether the search should be abandoned.
+    bool stagnated(size_t i);
+
+    // Charge the evaluations of the i'th solver since it was last charged,
+    // or one forward kinematics evaluation per iteration if it does not
+    // count them, to the cost of the current query.
+    void charge_work(size_t i, int iterations);
+
+    // Return the score of sol for the solve type; lower is better for
+    // Distance, higher for the Manipulation modes.
+    double score_solution(const KDL::JntArray& q_init, const KDL::JntArray& sol);
+
+    // Return whether sol scores better than every recorded solution.
+    bool improves_solution(const KDL::JntArray& q_init, const KDL::JntArray& sol);
+
+    // Record sol, already normalized, with its score for the solve type.
+    void add_solution(const KDL::JntArray& q_init, const KDL::JntArray& sol);
+
+    // Copy the best recorded solution into q_out and return the number of
+    // solutions, or NoSolution if there are none.
+    int best_solution(KDL::JntArray& q_out);
+
+    bool satisfies(
+        const KDL::JntArray& q,
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits);
+
+    bool setConsistencyLimits(
+        const KDL::JntArray& q_init,
+        const KDL::JntArray& consistency_limits);
+    void resetConsistencyLimits();
+
+    void seedQuery(
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits);
+
     void randomize(KDL::JntArray& q, const KDL::JntArray& q_init);
     void normalize_seed(const KDL::JntArray& seed, KDL::JntArray& solution);
     void normalize_limits(const KDL::JntArray& seed, KDL::JntArray& solution);
 
     bool unique_solution(const KDL::JntArray& sol);
+    bool accept_solution(const KDL::JntArray& sol, const SolutionFilter& filter);
 
     /* @brief Manipulation metrics and penalties taken from "Workspace
      Geometric Characterization and Manipulability of Industrial Robots",
@@ -0,0 +1,162 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_IK_CACHE_HPP
+#define DETERMINISTIC_TRAC_IK_IK_CACHE_HPP
+
+// standard includes
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// system includes
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// A bounded, least-recently-used cache of IK results.
+///
+/// Queries are keyed by their quantized target pose, seed, Cartesian bounds,
+/// consistency limits, and solve type, so that repeated queries at the same or
+/// nearly the same pose share an entry. Since quantization may map distinct
+/// queries to the same key, lookups take a predicate that validates the
+/// stored solution against the actual query before it is returned. A cache is
+/// only meaningful for a single chain and may be shared between solvers for
+/// that chain; all operations are thread-safe.
+class IKCache
+{
+public:
+
+    typedef std::vector<int64_t> Key;
+
+    IKCache(
+        size_t capacity = 1024,
+        double position_resolution = 1e-4,
+        double angle_resolution = 1e-3);
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const;
+
+    /// Build the key for a query. \p consistency_limits may be empty.
+    Key makeKey(
+        const KDL::JntArray& q_init,
+        const KDL::Frame& p_in,
+        const KDL::Twist& bounds,
+        const KDL::JntArray& consistency_limits,
+        int solve_type) const;
+
+    /// Return true and write the stored result to \p q_out and \p rc if an
+    /// entry for \p key exists and \p accept approves its solution.
+    bool lookup(
+        const Key& key,
+        KDL::JntArray& q_out,
+        int& rc,
+        const std::function<bool(const KDL::JntArray&)>& accept);
+
+    /// Store a result, evicting the least-recently-used entry if full.
+    void insert(const Key& key, const KDL::JntArray& q_out, int rc);
+
+    void clear();
+
+    /// \name Statistics
+    ///@{
+    uint64_t hits() const;
+    uint64_t misses() const;
+    void resetCounters();
+    ///@}
+
+    /// \name Persistence
+    ///
+    /// Snapshots record the ChainSignature() and joint count of the chain
+    /// the cache was filled for. Entries are written from least to most
+    /// recently used so that a restored cache preserves the eviction order.
+    /// Loading a snapshot of another chain or taken with different
+    /// resolutions is rejected.
+    ///
+    /// Caches of several solvers for a chain, e.g. one per thread, may save
+    /// to the same path: the entries of a snapshot already at \p path are
+    /// merged in as less recently used than those of this cache, up to its
+    /// capacity.
+    ///@{
+    bool save(
+        const std::string& path,
+        uint64_t chain_signature,
+        unsigned int num_joints) const;
+    bool load(
+        const std::string& path,
+        uint64_t chain_signature,
+        unsigned int num_joints);
+    ///@}
+
+private:
+
+    struct Entry
+    {
+        Key key;
+        KDL::JntArray q;
+        int rc;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    size_t capacity_;
+    double position_resolution_;
+    double angle_resolution_;
+
+    mutable std::mutex mutex_;
+
+    // most recently used entries at the front
+    EntryList entries_;
+    std::unordered_map<Key, EntryList::iterator, KeyHash> index_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+
+    void insertLocked(const Key& key, const KDL::JntArray& q_out, int rc);
+
+    bool readLocked(
+        const std::string& path,
+        uint64_t chain_signature,
+        unsigned int num_joints);
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
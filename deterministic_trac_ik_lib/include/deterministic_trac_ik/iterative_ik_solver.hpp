@@ -0,0 +1,128 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_ITERATIVE_IK_SOLVER_HPP
+#define DETERMINISTIC_TRAC_IK_ITERATIVE_IK_SOLVER_HPP
+
+// standard includes
+#include <memory>
+#include <stdint.h>
+
+// system includes
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+// project includes
+#include <deterministic_trac_ik/convergence_trace.hpp>
+#include <deterministic_trac_ik/cost_model.hpp>
+#include <deterministic_trac_ik/restart_policy.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// A numeric IK solver that can be advanced a bounded number of iterations
+/// at a time, so that several can be interleaved deterministically by
+/// Deterministic_TRAC_IK.
+class IterativeIkSolver
+{
+public:
+
+    virtual ~IterativeIkSolver() { }
+
+    /// Short name used in log messages.
+    virtual const char* name() const = 0;
+
+    /// \name Configuration
+    ///@{
+
+    /// Set the per-axis tolerances of the target frame.
+    virtual void setBounds(const KDL::Twist& bounds) = 0;
+
+    /// Set the tolerance on each component of the remaining twist error,
+    /// outside of the bounds, at which the solver reports convergence.
+    virtual void setEps(double eps) = 0;
+    virtual double eps() const = 0;
+
+    /// Restrict the joint limits searched, starting with the next restart(),
+    /// to [q_min, q_max], intersected with the limits given at construction.
+    virtual void setJointLimits(const KDL::JntArray& q_min, const KDL::JntArray& q_max) = 0;
+
+    /// Restore the joint limits given at construction.
+    virtual void resetJointLimits() = 0;
+
+    /// Reseed the random number generator used for restarts, if any.
+    virtual void setRandomSeed(uint64_t /*seed*/) { }
+
+    /// Set when the solver restarts on its own between calls to restart(),
+    /// for solvers that support it.
+    virtual void setRestartPolicy(const RestartPolicy& /*policy*/) { }
+
+    /// Return the restarts of the solver since the last call to
+    /// resetRestartCounters().
+    virtual RestartCounters restartCounters() const { return RestartCounters(); }
+    virtual void resetRestartCounters() { }
+
+    /// Record each iteration in \p trace, for solvers that support it and
+    /// if tracing is compiled in. Pass an empty pointer to stop recording.
+    virtual void setTrace(const std::shared_ptr<ConvergenceTrace>& /*trace*/) { }
+    ///@}
+
+    /// \name Iterative Cart-to-Joint Interface
+    ///@{
+
+    /// Reset the current position and target frame of the solver.
+    virtual void restart(const KDL::JntArray& q_init, const KDL::Frame& p_in) = 0;
+
+    /// Reset the current position, but NOT the target frame, of the solver.
+    virtual void restart(const KDL::JntArray& q_init) = 0;
+
+    /// Run up to \p steps iterations. Return 0 if the solver has converged
+    /// to a solution and a non-zero value otherwise.
+    virtual int step(int steps = 1) = 0;
+
+    /// Return the current configuration in the solver; the solution
+    /// configuration if the solver has converged to a solution.
+    virtual const KDL::JntArray& qout() const = 0;
+
+    /// Return the smallest norm of the remaining twist error, outside of the
+    /// bounds, reached since the target frame was last set.
+    virtual double bestResidual() const = 0;
+
+    /// Return whether work() counts the evaluations of this solver.
+    virtual bool countsWork() const { return false; }
+
+    /// Return the evaluations performed since construction, for solvers
+    /// that count them.
+    virtual WorkCounters work() const { return WorkCounters(); }
+    ///@}
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
@@ -32,11 +32,22 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #define KDLCHAINIKSOLVERPOS_TL_HPP
 
 // standard includes
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <random>
+#include <vector>
 
 // system includes
-#include <kdl/chainfksolverpos_recursive.hpp>
-#include <kdl/chainiksolvervel_pinv.hpp>
+#include <Eigen/SVD>
+#include <kdl/chain.hpp>
+#include <kdl/jacobian.hpp>
+#include <kdl/jntarray.hpp>
+
+// project includes
+#include <deterministic_trac_ik/chain_fk_jac.hpp>
+#include <deterministic_trac_ik/iterative_ik_solver.hpp>
+#include <deterministic_trac_ik/vel_solver.hpp>
 
 namespace KDL {
 
@@ -44,9 +55,29 @@ enum BasicJointType {
     RotJoint, TransJoint, Continuous
 };
 
+/// Classify \p joint, which must not be fixed, given its limits. Revolute
+/// joints whose limits are both at least float::max in magnitude are
+/// Continuous.
+BasicJointType ClassifyJoint(const Joint& joint, double q_min, double q_max);
+
+/// Classify the movable joints of \p chain, in order.
+std::vector<BasicJointType> ClassifyJoints(
+    const Chain& chain,
+    const JntArray& q_min,
+    const JntArray& q_max);
+
+/// Secondary objectives that ChainIkSolverPos_TL can descend within the null
+/// space of the Jacobian while converging to the target frame.
+enum NullSpaceObjective {
+    NullSpaceNone,
+    NullSpaceJointDistance,  // approach the configuration passed to restart()
+    NullSpaceJointLimits,    // approach the middle of the joint ranges
+    NullSpaceManipulability  // maximize sqrt(det(J * J^T))
+};
+
 /// An inverse kinematics algorithm that computes an inverse kinematics solution
 /// via repeated application.
-class ChainIkSolverPos_TL
+class ChainIkSolverPos_TL : public Deterministic_TRAC_IK::IterativeIkSolver
 {
 public:
 
@@ -58,35 +89,116 @@ public:
         bool random_restart = false,
         bool try_jl_wrap = false);
 
+    const char* name() const override { return "kdl"; }
+
     /// \name Configuration
     ///@{
-    void setBounds(const KDL::Twist& bounds) { bounds_ = bounds; }
+    /// Set the per-axis tolerances of the target frame. Axes whose tolerance
+    /// is at least float::max are dropped from the residual and Jacobian,
+    /// e.g. position-only IK solves a 3 x N system.
+    void setBounds(const KDL::Twist& bounds) override;
     auto bounds() const -> const KDL::Twist& { return bounds_; }
 
-    void setEps(double eps) { eps_ = eps; }
-    double eps() const { return eps_; }
+    void setEps(double eps) override { eps_ = eps; }
+    double eps() const override { return eps_; }
+
+    /// Restrict the joint limits used by restart(), step(), and random
+    /// restarts to [q_min, q_max], intersected with the limits given at
+    /// construction. Continuous joints become bounded within the window.
+    void setJointLimits(const KDL::JntArray& q_min, const KDL::JntArray& q_max) override;
+
+    /// Restore the joint limits given at construction.
+    void resetJointLimits() override;
+
+    void setRandomSeed(uint64_t seed) override;
+
+    /// Besides the policy, an attempt ends when a step no longer moves the
+    /// joints or, with setLineSearch(), no longer reduces the residual.
+    /// Restarts only happen if random restarts were enabled at construction.
+    void setRestartPolicy(const Deterministic_TRAC_IK::RestartPolicy& policy) override { restart_.setPolicy(policy); }
+    auto restartPolicy() const -> const Deterministic_TRAC_IK::RestartPolicy& { return restart_.policy(); }
+    Deterministic_TRAC_IK::RestartCounters restartCounters() const override { return restart_.counters(); }
+    void resetRestartCounters() override { restart_.resetCounters(); }
+
+    /// Each step is recorded as one iteration.
+    void setTrace(const std::shared_ptr<Deterministic_TRAC_IK::ConvergenceTrace>& trace) override { trace_ = trace; }
+
+    /// Select the strategy used to map the Cartesian error of each
+    /// iteration to a joint displacement. The default is VelSolverPinv.
+    /// Selecting a strategy resets the damping to DefaultDamping(type).
+    void setVelSolver(VelSolverType type);
+    VelSolverType velSolver() const { return vel_solver_type_; }
+
+    /// Set the damping applied by the velocity solver near singularities.
+    void setDamping(const AdaptiveDamping& damping);
+    auto damping() const -> const AdaptiveDamping& { return vel_solver_->damping(); }
+
+    /// Add the negative gradient of \p objective, scaled by \p gain and
+    /// projected into the null space of the Jacobian, to each step. With an
+    /// objective set, the solver reports convergence only once the projected
+    /// step has also settled, so that the first solution is near a local
+    /// optimum of the objective.
+    void setNullSpaceObjective(NullSpaceObjective objective, double gain = 0.5);
+    NullSpaceObjective nullSpaceObjective() const { return ns_objective_; }
+    double nullSpaceGain() const { return ns_gain_; }
+
+    /// Run the iterations after each restart in single precision, computing
+    /// the tip frame, Jacobian, and velocity step in float, until the
+    /// residual falls to \p coarse_eps; then continue in double precision
+    /// until it is within eps(). Far from the target the extra precision
+    /// does not change the outcome of an iteration. The null-space objective
+    /// only applies to double-precision iterations. 0, the default, runs
+    /// every iteration in double precision.
+    void setCoarseEps(double coarse_eps);
+    double coarseEps() const { return coarse_eps_; }
+
+    /// Halve a step, up to \p max_backtracks times, while it increases the
+    /// residual instead of reducing it. Steps that overshoot near joint
+    /// limits and singularities then shrink instead of oscillating, and a
+    /// step that no fraction of improves triggers the random restart at
+    /// once. 0, the default, always takes the full step.
+    void setLineSearch(int max_backtracks) { max_backtracks_ = max_backtracks; }
+    int lineSearch() const { return max_backtracks_; }
+
+    /// Drop joints resting on one of their limits from the Jacobian of an
+    /// iteration whose step would push them further into it, and solve
+    /// again, so the other joints absorb the error instead. A joint rejoins
+    /// once the step pulls it back into its range. Works best together with
+    /// setLineSearch(). Disabled by default.
+    void setActiveSet(bool enabled) { active_set_ = enabled; }
+    bool activeSet() const { return active_set_; }
     ///@}
 
     /// \name Iterative Cart-to-Joint Interface
     ///@{
 
-    /// Reset the current position and target frame of the solver.
-    void restart(const KDL::JntArray& q_init, const KDL::Frame& p_in);
+    /// Reset the current position and target frame of the solver. \p q_init
+    /// also becomes the reference for NullSpaceJointDistance.
+    void restart(const KDL::JntArray& q_init, const KDL::Frame& p_in) override;
 
     /// Reset the current position, but NOT the target frame, of the solver.
-    void restart(const KDL::JntArray& q_init);
+    void restart(const KDL::JntArray& q_init) override;
 
     /// Step through a single iteration of the solver.
     ///
     /// Returns 0 if the solver has already converged to a solution and a
     /// non-zero value otherwise.
-    int step(int steps = 1);
+    int step(int steps = 1) override;
 
     ///@}
 
     /// Return the current configuration in the solver; the solution
     /// configuration if the solver has converged to a solution.
-    const KDL::JntArray& qout() const { return *q_curr_; }
+    const KDL::JntArray& qout() const override { return *q_curr_; }
+
+    double bestResidual() const override { return best_residual_; }
+
+    /// Each update of the current configuration counts as a forward
+    /// kinematics and a Jacobian evaluation, computed in one pass. Only the
+    /// pseudo-inverse velocity solver and the null-space projection perform
+    /// SVDs; the other velocity solvers cost little next to a Jacobian.
+    bool countsWork() const override { return true; }
+    Deterministic_TRAC_IK::WorkCounters work() const override { return work_; }
 
     int CartToJnt(
         const KDL::JntArray& q_init,
@@ -97,18 +209,46 @@ public:
 private:
 
     const Chain chain_;
+
+    // joint limits given at construction
+    JntArray chain_min_;
+    JntArray chain_max_;
+    std::vector<KDL::BasicJointType> chain_types_;
+
+    // joint limits used by the current search
     JntArray joint_min_;
     JntArray joint_max_;
     std::vector<KDL::BasicJointType> joint_types_;
 
     std::default_random_engine rng_;
-
-    KDL::ChainIkSolverVel_pinv vik_solver_;
-    KDL::ChainFkSolverPos_recursive fk_solver_;
+    Deterministic_TRAC_IK::RestartMonitor restart_;
+
+    // computes the tip frame and Jacobian of the current configuration in
+    // one pass; both are reused by the next iteration's velocity step
+    KDL::ChainFkJacSolver fk_jac_solver_;
+    std::unique_ptr<VelSolver> vel_solver_;
+    VelSolverType vel_solver_type_;
+    TaskJacobian task_jac_;
+    TaskVector task_err_;
+
+    // single-precision counterparts used until the residual reaches
+    // coarse_eps_
+    double coarse_eps_;
+    bool coarse_;
+    KDL::ChainFkJacKernel<float> coarse_fk_jac_;
+    KDL::ChainFkJacKernel<float>::Jacobian coarse_jac_;
+    std::unique_ptr<VelSolverT<float>> coarse_vel_solver_;
+    TaskJacobianT<float> coarse_task_jac_;
+    TaskVectorT<float> coarse_task_err_;
+    Eigen::VectorXf coarse_delta_q_;
 
     // step configuration
     KDL::Twist bounds_;
+    unsigned int free_axes_;
+    std::vector<int> task_rows_;
     double eps_;
+    int max_backtracks_;
+    bool active_set_;
     bool rr_;
     bool wrap_;
 
@@ -124,14 +264,100 @@ private:
 
     bool done_;
 
+    // smallest residual since the target was set, kept across restarts
+    double best_residual_;
+
+    // residual of q_curr_; infinite right after a restart
+    double residual_;
+
+    // per joint of q_curr_: -1 or 1 if it rests on its lower or upper limit
+    // and is dropped from the next step, 0 otherwise
+    std::vector<int> saturated_;
+
+    Deterministic_TRAC_IK::WorkCounters work_;
+
+    // steps since the target was set, and whether the next step is the
+    // first after a restart
+    std::shared_ptr<Deterministic_TRAC_IK::ConvergenceTrace> trace_;
+    uint64_t trace_step_;
+    bool trace_restarted_;
+
     KDL::Frame f_curr_;
+    KDL::Jacobian jac_curr_;
     KDL::JntArray delta_q_;
 
     KDL::Frame f_target_;
 
+    // null-space objective
+    NullSpaceObjective ns_objective_;
+    double ns_gain_;
+    KDL::JntArray q_ref_;
+    Eigen::JacobiSVD<TaskJacobian> ns_svd_;
+    Eigen::VectorXd ns_grad_;
+    Eigen::VectorXd ns_proj_;
+    double ns_step_;
+    int ns_settle_;
+
+    // scratch space for the manipulability gradient
+    KDL::JntArray ns_q_;
+    KDL::Frame ns_f_;
+    KDL::Jacobian ns_jac_;
+
     void randomize(KDL::JntArray& q);
+
+    // Move q_curr_ to the start of the next attempt, as chosen by the
+    // restart policy, and update its kinematics.
+    void randomRestart();
+
+    // Record which joints of q_curr_ rest on a limit.
+    void updateSaturated();
+
+    // Record the current step in trace_, if tracing is compiled in.
+    void trace(double residual, bool clamped);
+
+    // Update the tip frame and Jacobian of q_curr_, in the precision of the
+    // current phase.
+    void updateKinematics();
+
+    // Return the residual of the current tip frame, in the target frame,
+    // with the components within bounds_ zeroed.
+    KDL::Twist boundedResidual() const;
+
+    // Compute the joint displacement for the Cartesian displacement
+    // delta_twist from jac_curr_ using the selected velocity solver.
+    void solveVelocity(const KDL::Twist& delta_twist, KDL::JntArray& delta_q);
+
+    // Add the projected null-space step of the current objective to delta_q.
+    // Must follow solveVelocity() for the same configuration.
+    void addNullSpaceStep(KDL::JntArray& delta_q);
+
+    // Compute the gradient of the current objective at q_curr_ into ns_grad_.
+    void objectiveGradient();
+
+    // log(sqrt(det(J * J^T))), or -inf at a singularity
+    static double logManipulability(const KDL::Jacobian& jac);
+};
+
+/// Bit masks over the components of a Twist, in KDL's [vel, rot] order.
+enum TwistAxes : unsigned int {
+    TwistVelAxes = 0x07,
+    TwistRotAxes = 0x38,
+    TwistAllAxes = 0x3F
 };
 
+/// Return a mask of the components of \p bounds that leave their axis
+/// unconstrained, i.e. that are at least float::max.
+inline unsigned int FreeAxes(const Twist& bounds)
+{
+    unsigned int mask = 0;
+    for (int i = 0; i < 6; ++i) {
+        if (std::abs(bounds[i]) >= std::numeric_limits<float>::max()) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
 /**
  * determines the rotation axis necessary to rotate from frame b1 to the
  * orientation of frame b2 and the vector necessary to translate the origin
@@ -153,6 +379,24 @@ IMETHOD Twist diffRelative(
             F_a_b1.M.Inverse() * diff(F_a_b1.M, F_a_b2.M, dt));
 }
 
+/// Same as diffRelative, but skips the translational or rotational part, and
+/// leaves it zero, when all of its axes are set in \p free_axes. Named apart
+/// from diffRelative, whose dt an integer argument would also convert to.
+IMETHOD Twist diffRelativeFree(
+    const Frame & F_a_b1,
+    const Frame & F_a_b2,
+    unsigned int free_axes)
+{
+    Twist t = Twist::Zero();
+    if ((free_axes & TwistVelAxes) != TwistVelAxes) {
+        t.vel = F_a_b1.M.Inverse() * diff(F_a_b1.p, F_a_b2.p);
+    }
+    if ((free_axes & TwistRotAxes) != TwistRotAxes) {
+        t.rot = F_a_b1.M.Inverse() * diff(F_a_b1.M, F_a_b2.M);
+    }
+    return t;
+}
+
 } // namespace KDL
 
 #endif
@@ -32,10 +32,12 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #define NLOPT_IK_HPP
 
 // system includes
+#include <kdl/chainfksolverpos_recursive.hpp>
 #include <nlopt.hpp>
 
 // project includes
 #include <deterministic_trac_ik/dual_quaternion.h>
+#include <deterministic_trac_ik/iterative_ik_solver.hpp>
 #include <deterministic_trac_ik/kdl_tl.hpp>
 
 namespace NLOPT_IK {
@@ -48,7 +50,7 @@ enum OptType
     L2
 };
 
-class NLOPT_IK
+class NLOPT_IK : public Deterministic_TRAC_IK::IterativeIkSolver
 {
 public:
 
@@ -59,33 +61,91 @@ public:
         double eps = 1e-3,
         OptType type = SumSq);
 
+    const char* name() const override { return "nlopt"; }
+
     /// \name Configuration
     ///@{
-    void setBounds(const KDL::Twist& bounds) { bounds_ = bounds; }
+    /// Set the per-axis tolerances of the target frame. The translational or
+    /// rotational error is not computed when all of its tolerances are at
+    /// least float::max.
+    void setBounds(const KDL::Twist& bounds) override
+    {
+        bounds_ = bounds;
+        free_axes_ = KDL::FreeAxes(bounds);
+    }
     auto bounds() -> const KDL::Twist& { return bounds_; }
 
-    void setEps(double eps) { eps_ = eps; }
-    double eps() const { return eps_; }
+    void setEps(double eps) override { eps_ = eps; }
+    double eps() const override { return eps_; }
+
+    /// Select the objective minimized, starting with the next restart().
+    /// Joint minimizes the distance to the seed subject to reaching the
+    /// target, which requires an algorithm supporting equality constraints;
+    /// with any other, the solver falls back to LD_SLSQP.
+    void setOptType(OptType type);
+    OptType optType() const { return opt_type_; }
+
+    /// Select the gradient-based NLopt algorithm, e.g. LD_SLSQP (the
+    /// default), LD_LBFGS, LD_MMA or LD_CCSAQ, starting with the next
+    /// restart(). The algorithm is kept while the Joint objective falls back
+    /// to LD_SLSQP.
+    void setAlgorithm(nlopt::algorithm algorithm);
+    nlopt::algorithm algorithm() const { return algorithm_; }
+
+    /// Set the absolute tolerance on each joint at which the optimization
+    /// of a step stops, starting with the next restart(). Defaults to the
+    /// epsilon of float.
+    void setXTolAbs(double xtol);
+    double xtolAbs() const { return xtol_; }
+
+    /// Restrict the joint limits used to bound the optimization, starting
+    /// with the next restart(), to [q_min, q_max], intersected with the limits
+    /// given at construction. Continuous joints become bounded within the
+    /// window.
+    void setJointLimits(const KDL::JntArray& q_min, const KDL::JntArray& q_max) override;
+
+    /// Restore the joint limits given at construction.
+    void resetJointLimits() override;
+
+    void setRandomSeed(uint64_t seed) override;
+
+    /// The policy is checked after each step(); without one, the solver
+    /// keeps optimizing from wherever its last step() ended.
+    void setRestartPolicy(const Deterministic_TRAC_IK::RestartPolicy& policy) override { restart_.setPolicy(policy); }
+    auto restartPolicy() const -> const Deterministic_TRAC_IK::RestartPolicy& { return restart_.policy(); }
+    Deterministic_TRAC_IK::RestartCounters restartCounters() const override { return restart_.counters(); }
+    void resetRestartCounters() override { restart_.resetCounters(); }
+
+    /// Each evaluation of the objective is recorded as one iteration.
+    void setTrace(const std::shared_ptr<Deterministic_TRAC_IK::ConvergenceTrace>& trace) override { trace_ = trace; }
     ///@}
 
     /// \name Iterative Cart-to-Joint Interface
     ///@{
 
     ///  Reset the current position and target frame of the solver.
-    void restart(const KDL::JntArray& q_init, const KDL::Frame& p_in);
+    void restart(const KDL::JntArray& q_init, const KDL::Frame& p_in) override;
 
     /// Reset the current position, but NOT the target frame, of the solver.
-    void restart(const KDL::JntArray& q_init);
+    void restart(const KDL::JntArray& q_init) override;
 
     /// Step through a single iteration of the solver.
     ///
     /// Returns 0 if the solver finds a solution or has already converted to a
     /// solution and a non-zero value otherwise.
-    int step(int steps = 1);
+    int step(int steps = 1) override;
 
     /// Return the current configuration in the solver; the solution
     /// configuration if the solver has converged to a solution.
-    const KDL::JntArray& qout() const;
+    const KDL::JntArray& qout() const override;
+
+    double bestResidual() const override { return best_residual_; }
+
+    /// Each evaluation of a Cartesian objective or constraint counts as a
+    /// forward kinematics evaluation, including those of the finite
+    /// differences approximating its gradient.
+    bool countsWork() const override { return true; }
+    Deterministic_TRAC_IK::WorkCounters work() const override { return work_; }
     ///@}
 
     /// User command to start an IK solve. Takes in a seed configuration, a
@@ -120,11 +180,21 @@ public:
     // minimization objective for OptType::L2.
     void cartL2NormError(const std::vector<double>& x, double error[]);
 
+    // Record the norm of the bounded twist error of an evaluated point.
+    void updateResidual(const KDL::Twist& delta_twist);
+
     std::vector<double> tmp_;
 
 private:
 
     const KDL::Chain chain_;
+
+    // joint limits given at construction
+    std::vector<double> chain_min_;
+    std::vector<double> chain_max_;
+    std::vector<KDL::BasicJointType> chain_types_;
+
+    // joint limits used by the current search
     std::vector<double> joint_min_;
     std::vector<double> joint_max_;
     std::vector<KDL::BasicJointType> types_;
@@ -135,6 +205,7 @@ private:
 
     // Problem Configuration
     KDL::Twist bounds_;
+    unsigned int free_axes_;
     double eps_;
 
     dual_quaternion target_dq_;         // the target duql quaternion for cost computation
@@ -153,9 +224,36 @@ private:
     // -1 for nans computed in one of the solver functions?
     int progress_;
 
+    // smallest residual since the target was set, kept across restarts
+    double best_residual_;
+
+    // smallest residual evaluated during the current step()
+    double step_residual_;
+
+    std::default_random_engine rng_;
+    Deterministic_TRAC_IK::RestartMonitor restart_;
+
+    Deterministic_TRAC_IK::WorkCounters work_;
+
+    // evaluations since the target was set, and whether the next one is the
+    // first after a restart
+    std::shared_ptr<Deterministic_TRAC_IK::ConvergenceTrace> trace_;
+    uint64_t trace_step_;
+    bool trace_restarted_;
+
     OptType opt_type_;
+    nlopt::algorithm algorithm_;
+    double xtol_;
 
     nlopt::opt nlopt_;
+
+    // Create the optimizer for the objective, algorithm and tolerance.
+    void configure();
+
+    // Start a new attempt of the optimization from q_init.
+    void initialize(const KDL::JntArray& q_init);
+
+    void randomize(KDL::JntArray& q);
 };
 
 } // namespace NLOPT_IK
@@ -0,0 +1,183 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_QUERY_LOG_HPP
+#define DETERMINISTIC_TRAC_IK_QUERY_LOG_HPP
+
+// standard includes
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// system includes
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// The options of a Deterministic_TRAC_IK that affect the outcome of its
+/// queries and are the same for all queries of a log. Enumerations are
+/// stored as their integer values.
+struct SolverOptions
+{
+    /// Components of the solver that a replay cannot reproduce.
+    enum External
+    {
+        Cache = 1 << 0,
+        ReachabilityMap = 1 << 1,
+        AnalyticSolver = 1 << 2
+    };
+
+    SolverOptions();
+
+    double singularity_threshold;
+    double max_damping;
+    double nullspace_gain;
+    double nlopt_xtol;
+    double coarse_eps;
+    double candidate_eps;
+    double stagnation_threshold;
+    double stagnation_min_improvement;
+    double restart_plateau_improvement;
+    double restart_perturbation;
+    double cost_fk;
+    double cost_jacobian;
+    double cost_svd;
+
+    int32_t vel_solver;                 // KDL::VelSolverType
+    int32_t nullspace_objective;        // KDL::NullSpaceObjective
+    int32_t nlopt_type;                 // NLOPT_IK::OptType
+    int32_t nlopt_algorithm;            // nlopt::algorithm
+    int32_t line_search;
+    int32_t active_set;
+    int32_t stagnation_patience;
+    int32_t restart_plateau_window;
+    int32_t restart_max_steps;
+    int32_t restart_sampling;           // RestartPolicy::Sampling
+
+    // whether the chain was compiled, i.e. the queries were solved on
+    // CompiledChain(chain, ...).chain() rather than on the chain itself
+    int32_t compiled_chain;
+
+    int32_t external;                   // External flags
+
+    bool operator==(const SolverOptions& other) const;
+    bool operator!=(const SolverOptions& other) const { return !(*this == other); }
+};
+
+/// One call of Deterministic_TRAC_IK::CartToJnt and its outcome.
+struct QueryRecord
+{
+    QueryRecord();
+
+    KDL::Frame pose;
+    KDL::JntArray seed;
+    KDL::Twist bounds;
+    KDL::JntArray consistency_limits;   // empty if none were given
+
+    int32_t solve_type;
+    int32_t max_iterations;
+    double eps;
+    bool per_query_seeding;
+    uint64_t seed_salt;
+    double cost_budget;                 // 0 if bounded by iterations
+
+    // a solution filter was given; a replay cannot reproduce its decisions
+    bool filtered;
+
+    int32_t result;                     // return value of CartToJnt
+    KDL::JntArray solution;             // empty unless result >= 0
+    uint32_t iterations;                // numeric solver iterations run
+    uint64_t duration_ns;
+};
+
+/// A ring of QueryRecords in a memory-mapped file. Recording a query only
+/// copies it into the mapping, leaving the write to the kernel, so logging
+/// can stay enabled in production. Once the ring is full, the oldest
+/// records are overwritten. All records are for one chain. Several
+/// QueryLogs, in one process or several, may append to the same file.
+class QueryLog
+{
+public:
+
+    QueryLog();
+    ~QueryLog();
+
+    QueryLog(const QueryLog&) = delete;
+    QueryLog& operator=(const QueryLog&) = delete;
+
+    /// Map a ring of \p capacity records at \p path for a chain with
+    /// \p num_joints joints and the given ChainSignature(), solved with
+    /// \p options. An existing log with the same layout, chain and options
+    /// is appended to; any other file is replaced by a new one, leaving the
+    /// old one to those that mapped it.
+    bool open(
+        const std::string& path,
+        unsigned int num_joints,
+        uint64_t capacity,
+        uint64_t chain_signature,
+        const SolverOptions& options);
+
+    void close();
+
+    bool valid() const { return header_ != nullptr; }
+
+    /// Append \p record, which must be for the chain given to open().
+    /// Thread-safe, also across QueryLogs appending to the same file.
+    void record(const QueryRecord& record);
+
+    /// Return the number of records appended since the file was created,
+    /// including those since overwritten.
+    uint64_t count() const;
+
+    /// Read the records of the query log at \p path, oldest first, the
+    /// ChainSignature() of its chain and the options it was solved with.
+    static bool read(
+        const std::string& path,
+        std::vector<QueryRecord>& records,
+        uint64_t& chain_signature,
+        SolverOptions& options);
+
+private:
+
+    struct Header;
+
+    std::mutex mutex_;
+
+    void* mapping_;
+    size_t mapping_size_;
+    Header* header_;
+    size_t record_size_;
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
@@ -0,0 +1,128 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_REACHABILITY_MAP_HPP
+#define DETERMINISTIC_TRAC_IK_REACHABILITY_MAP_HPP
+
+// standard includes
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// system includes
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// A voxel grid, in the chain's base frame, recording which directions of
+/// the tip frame's z-axis were reached by forward kinematics samples in each
+/// voxel. After sampling, every voxel and direction bin is dilated by one
+/// cell so that the map errs toward reporting poses as reachable.
+class ReachabilityMap
+{
+public:
+
+    /// Number of bins of the tip z-axis direction: a 3 x 3 grid on each face
+    /// of a cube map.
+    static const int OrientationBins = 54;
+
+    ReachabilityMap();
+    ~ReachabilityMap();
+
+    ReachabilityMap(const ReachabilityMap&) = delete;
+    ReachabilityMap& operator=(const ReachabilityMap&) = delete;
+
+    /// Sample \p num_samples configurations uniformly within the joint
+    /// limits, using \p num_threads threads (0 for one per core), and record
+    /// the tip frame of each. Continuous joints are sampled over [-pi, pi].
+    /// The result depends only on \p seed and \p num_threads.
+    bool build(
+        const KDL::Chain& chain,
+        const KDL::JntArray& q_min,
+        const KDL::JntArray& q_max,
+        double resolution,
+        uint64_t num_samples,
+        unsigned int num_threads = 0,
+        unsigned int seed = 0);
+
+    bool save(const std::string& path) const;
+
+    /// Map the file at \p path, written by save(), into memory.
+    bool load(const std::string& path);
+
+    bool valid() const { return masks_ != nullptr; }
+
+    /// Return the ChainSignature() of the chain the map was built for.
+    uint64_t chainSignature() const { return signature_; }
+
+    double resolution() const { return resolution_; }
+
+    /// Return false if no sample came near \p p within \p bounds. The tip
+    /// orientation is only considered when all rotational bounds are zero,
+    /// and the map is not consulted at all when a translational axis is free.
+    bool reachable(
+        const KDL::Frame& p,
+        const KDL::Twist& bounds = KDL::Twist::Zero()) const;
+
+private:
+
+    struct Header;
+
+    uint64_t signature_;
+    double resolution_;
+    double origin_[3];
+    int32_t dims_[3];
+
+    // owned storage after build(); empty when the map was loaded
+    std::vector<uint64_t> storage_;
+
+    // mapped file after load()
+    void* mapping_;
+    size_t mapping_size_;
+
+    const uint64_t* masks_;
+
+    void unmap();
+
+    bool voxel(const KDL::Vector& p, int32_t v[3]) const;
+
+    size_t index(int32_t x, int32_t y, int32_t z) const
+    {
+        return ((size_t)z * dims_[1] + y) * dims_[0] + x;
+    }
+
+    static int orientationBin(const KDL::Vector& axis);
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
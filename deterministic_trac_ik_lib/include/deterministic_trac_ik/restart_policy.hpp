@@ -0,0 +1,155 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_RESTART_POLICY_HPP
+#define DETERMINISTIC_TRAC_IK_RESTART_POLICY_HPP
+
+// standard includes
+#include <cstdint>
+#include <random>
+
+// system includes
+#include <kdl/jntarray.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// When an iterative solver abandons its current attempt, and where it
+/// starts the next one. Each criterion is counted in iterations of the
+/// solver, never in time, so restarts are reproducible.
+///
+/// An attempt ends on a plateau once its best residual (the norm of the
+/// twist error outside of the bounds) has not dropped by more than
+/// \p plateau_improvement, relative to its value at the start of the
+/// window, over \p plateau_window iterations, or once it has run
+/// \p max_steps iterations. The next attempt either starts from a uniform
+/// sample of the joint space (Resample), or from the best configuration
+/// found since the last restart() of the solver with each joint displaced
+/// uniformly by up to \p perturbation (Perturb). Solvers also end attempts
+/// by their own stall criteria; those always resample, since the best
+/// configuration is then usually the local minimum just left.
+struct RestartPolicy
+{
+    enum Sampling
+    {
+        Resample,
+        Perturb
+    };
+
+    RestartPolicy() :
+        plateau_window(0),
+        plateau_improvement(1e-2),
+        max_steps(0),
+        sampling(Resample),
+        perturbation(0.1)
+    { }
+
+    int plateau_window;         // 0 disables plateau detection
+    double plateau_improvement;
+    int max_steps;              // 0 for no limit
+    Sampling sampling;
+    double perturbation;        // radians or meters
+};
+
+/// Restarts of a solver by cause, accumulated until reset.
+struct RestartCounters
+{
+    RestartCounters() :
+        stalls(0), plateaus(0), step_limits(0), perturbations(0)
+    { }
+
+    uint64_t stalls;        // ended by the solver's own criterion
+    uint64_t plateaus;
+    uint64_t step_limits;
+    uint64_t perturbations; // restarts that perturbed the best configuration
+
+    uint64_t restarts() const { return stalls + plateaus + step_limits; }
+
+    RestartCounters& operator+=(const RestartCounters& other);
+};
+
+/// Applies a RestartPolicy to the iterations of a solver and keeps its
+/// RestartCounters.
+class RestartMonitor
+{
+public:
+
+    RestartMonitor();
+
+    void setPolicy(const RestartPolicy& policy) { policy_ = policy; }
+    const RestartPolicy& policy() const { return policy_; }
+
+    const RestartCounters& counters() const { return counters_; }
+    void resetCounters() { counters_ = RestartCounters(); }
+
+    /// Start the first attempt from a new seed or target, forgetting the
+    /// best configuration.
+    void reset();
+
+    /// Record \p steps iterations of the current attempt, ending at \p q
+    /// with \p residual. Return true, and count the cause, if the policy
+    /// ends the attempt.
+    bool update(const KDL::JntArray& q, double residual, int steps = 1);
+
+    /// Count an attempt ended by the solver's own criterion.
+    void stalled()
+    {
+        ++counters_.stalls;
+        ended_by_policy_ = false;
+    }
+
+    /// Start the next attempt. If the policy ended the last one, perturbs,
+    /// and a best configuration is known, write it, perturbed, to \p q and
+    /// return true.
+    /// Otherwise return false; the solver then samples \p q itself. The
+    /// result may lie outside of the joint limits.
+    bool next(KDL::JntArray& q, std::default_random_engine& rng);
+
+private:
+
+    RestartPolicy policy_;
+    RestartCounters counters_;
+
+    // best configuration since reset()
+    KDL::JntArray best_q_;
+    double best_residual_;
+
+    // current attempt
+    int attempt_steps_;
+    double attempt_residual_;
+    int window_steps_;
+    double window_residual_;
+    bool ended_by_policy_;
+
+    void beginAttempt();
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
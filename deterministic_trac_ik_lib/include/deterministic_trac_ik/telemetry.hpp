@@ -0,0 +1,123 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_TELEMETRY_HPP
+#define DETERMINISTIC_TRAC_IK_TELEMETRY_HPP
+
+// standard includes
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace Deterministic_TRAC_IK {
+
+/// A histogram of non-negative integers with a bounded relative error, in
+/// the style of HdrHistogram: values below 32 are counted exactly, and each
+/// power of two above is split into 16 buckets, so a reported percentile is
+/// within 1/16 of the recorded value. Values of 2^40 or more share the last
+/// bucket. Recording is lock-free and may run concurrently with reads.
+class Histogram
+{
+public:
+
+    Histogram();
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void record(uint64_t value);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    /// Return the upper bound of the bucket holding the \p p'th quantile,
+    /// with \p p in [0, 1], or 0 if nothing was recorded.
+    uint64_t percentile(double p) const;
+
+    void reset();
+
+private:
+
+    static const int SubBucketBits = 4;
+    static const int MaxValueBits = 40;
+    static const int NumBuckets = (MaxValueBits - SubBucketBits + 1) << SubBucketBits;
+
+    static int bucket(uint64_t value);
+    static uint64_t bucketUpperBound(int bucket);
+
+    std::atomic<uint64_t> counts_[NumBuckets];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+/// Aggregate statistics of the IK and FK queries served by a solver, kept
+/// lock-free so that they can stay enabled in production.
+struct IKTelemetry
+{
+    IKTelemetry();
+
+    Histogram ik_latency;           // nanoseconds
+    Histogram fk_latency;           // nanoseconds
+
+    // percentage of the iteration budget of each query that was spent
+    Histogram budget_utilization;
+
+    std::atomic<uint64_t> successes;
+    std::atomic<uint64_t> failures;
+
+    // candidates rejected by the solution filter, e.g. a collision check
+    std::atomic<uint64_t> callback_rejections;
+
+    std::atomic<uint64_t> iterations_used;
+    std::atomic<uint64_t> iterations_budget;
+
+    /// Record an IK query that spent \p iterations of a budget of \p
+    /// budget iterations.
+    void recordIK(bool success, uint64_t duration_ns, uint64_t iterations, uint64_t budget);
+
+    void recordFK(uint64_t duration_ns) { fk_latency.record(duration_ns); }
+
+    void recordRejection() { callback_rejections.fetch_add(1, std::memory_order_relaxed); }
+
+    /// Write the statistics as YAML, under the key \p name.
+    void write(std::ostream& os, const std::string& name) const;
+
+    /// Write the statistics to \p path, replacing its contents.
+    bool save(const std::string& path, const std::string& name) const;
+
+    void reset();
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
@@ -0,0 +1,224 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_TREE_IK_SOLVER_HPP
+#define DETERMINISTIC_TRAC_IK_TREE_IK_SOLVER_HPP
+
+// standard includes
+#include <stdint.h>
+#include <random>
+#include <string>
+#include <vector>
+
+// system includes
+#include <Eigen/Dense>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <kdl/tree.hpp>
+
+// project includes
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/kdl_tl.hpp>
+#include <deterministic_trac_ik/vel_solver.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// Solves for the poses of several tips of a tree jointly.
+///
+/// The solver works on the union of the chains from a common base to each
+/// tip, so joints shared by several tips (e.g., a torso carrying two arms)
+/// move once to serve all of them. Each iteration computes the frame of
+/// every segment of the union, shared trunk included, only once, stacks the
+/// Jacobians of all tips and takes a damped least-squares step, restarting
+/// from a random configuration when the iteration gets stuck.
+///
+/// Joints are numbered in the order they are met walking the chain to each
+/// tip in turn, skipping those already met, as done by InitKDLTree.
+class TreeIkSolver
+{
+public:
+
+    /// Every tip in \p tip_names must be a descendant of \p base_name in
+    /// \p tree. \p q_min and \p q_max are the limits of the joints of the
+    /// union of their chains. Otherwise the solver is not valid() and has no
+    /// tips.
+    TreeIkSolver(
+        const KDL::Tree& tree,
+        const std::string& base_name,
+        const std::vector<std::string>& tip_names,
+        const KDL::JntArray& q_min,
+        const KDL::JntArray& q_max,
+        int max_iters = 100,
+        double eps = 1e-5);
+
+    /// Return whether the chains to all tips were found and match the joint
+    /// limits.
+    bool valid() const { return valid_; }
+
+    unsigned int getNrOfJoints() const { return joint_min_.rows(); }
+    unsigned int getNrOfTips() const { return tips_.size(); }
+
+    void setMaxIterations(int max_iters) { max_iters_ = max_iters; }
+
+    /// Return the number of iterations spent by the last call to CartToJnt,
+    /// in the same units as setMaxIterations().
+    unsigned int getLastIterations() const { return iterations_; }
+
+    /// Set the damping applied to the stacked step near singularities. The
+    /// step is always solved by damped least squares, so the default is
+    /// KDL::DefaultDamping(KDL::VelSolverDLS).
+    void setDamping(const KDL::AdaptiveDamping& damping) { damping_ = damping; }
+    const KDL::AdaptiveDamping& damping() const { return damping_; }
+
+    /// If \p enabled, reseed the random number generator at the start of each
+    /// call to CartToJnt from a hash of its inputs and \p salt, as done by
+    /// Deterministic_TRAC_IK::setPerQuerySeeding. Disabled by default.
+    void setPerQuerySeeding(bool enabled, uint64_t salt = 0)
+    {
+        per_query_seeding_ = enabled;
+        seed_salt_ = salt;
+    }
+    bool getPerQuerySeeding() const { return per_query_seeding_; }
+
+    /// Restrict the joint limits searched, starting with the next call to
+    /// CartToJnt, to [q_min, q_max], intersected with the limits given at
+    /// construction.
+    void setJointLimits(const KDL::JntArray& q_min, const KDL::JntArray& q_max);
+
+    /// Restore the joint limits given at construction.
+    void resetJointLimits();
+
+    /// Search for a configuration that places each tip at the pose at the
+    /// same index in \p p_in, starting from \p q_init. \p bounds holds the
+    /// per-axis tolerances of each tip, in the frame of its target; if
+    /// empty, every tip must be reached exactly. If given, \p filter must
+    /// accept a solution for it to be returned.
+    ///
+    /// Return 0 on success and NoSolution if no accepted solution was found
+    /// within the iteration budget, or if the solver is not valid.
+    int CartToJnt(
+        const KDL::JntArray& q_init,
+        const std::vector<KDL::Frame>& p_in,
+        KDL::JntArray& q_out,
+        const std::vector<KDL::Twist>& bounds = std::vector<KDL::Twist>(),
+        const SolutionFilter& filter = SolutionFilter());
+
+    /// Compute the frames of all tips at \p q.
+    void JntToCart(const KDL::JntArray& q, std::vector<KDL::Frame>& p_out);
+
+    /// Compute the frame of the segment \p name, which must be in the union
+    /// of the chains, at \p q. Return 0 on success and a negative value if
+    /// the segment is not found.
+    int JntToCart(const KDL::JntArray& q, const std::string& name, KDL::Frame& p_out);
+
+private:
+
+    struct TreeSegment
+    {
+        KDL::Segment segment;
+        int parent; // index of the parent segment, -1 for a child of the base
+        int joint;  // index of the joint, -1 for fixed joints
+    };
+
+    struct Tip
+    {
+        // joint-carrying segments from the base to the tip
+        std::vector<int> joint_segments;
+        int segment;
+
+        // per-target state of the current query
+        KDL::Frame target;
+        KDL::Twist bounds;
+        unsigned int free_axes;
+        std::vector<int> rows;
+    };
+
+    bool valid_;
+
+    // segments of the union of the chains, each after its parent
+    std::vector<TreeSegment> segments_;
+    std::vector<Tip> tips_;
+
+    // joint limits given at construction
+    KDL::JntArray chain_min_;
+    KDL::JntArray chain_max_;
+    std::vector<KDL::BasicJointType> chain_types_;
+
+    // joint limits used by the current search
+    KDL::JntArray joint_min_;
+    KDL::JntArray joint_max_;
+    std::vector<KDL::BasicJointType> joint_types_;
+
+    int max_iters_;
+    double eps_;
+    KDL::AdaptiveDamping damping_;
+
+    // iterations spent by the last call to CartToJnt
+    unsigned int iterations_;
+
+    std::default_random_engine rng_;
+    bool per_query_seeding_;
+    uint64_t seed_salt_;
+
+    // per segment: frame in the base frame, and unit twist of its joint in
+    // the base frame with its reference point at the segment tip
+    std::vector<KDL::Frame> frames_;
+    std::vector<KDL::Twist> twists_;
+
+    KDL::JntArray q_curr_;
+    KDL::JntArray q_next_;
+
+    // stacked constrained rows of all tips
+    Eigen::MatrixXd jac_;
+    Eigen::VectorXd err_;
+    Eigen::MatrixXd gram_;
+    Eigen::LDLT<Eigen::MatrixXd> ldlt_;
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig_;
+    Eigen::VectorXd tmp_;
+    Eigen::VectorXd delta_q_;
+
+    int findSegment(const std::string& name) const;
+
+    // Compute frames_ and twists_ at q in one pass over the union.
+    void updateKinematics(const KDL::JntArray& q);
+
+    // Fill jac_ and err_ from the current kinematics and targets.
+    void updateTask();
+
+    // Whether every tip is within its bounds of its target.
+    bool converged() const;
+
+    void solveVelocity();
+    void randomize(KDL::JntArray& q);
+};
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
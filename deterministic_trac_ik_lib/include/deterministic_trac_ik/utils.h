@@ -2,14 +2,18 @@
 #define DETERMINISTIC_TRAC_IK_UTILS_H
 
 // standard includes
+#include <stdint.h>
 #include <stdlib.h>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <vector>
 
 #include <ros/ros.h>
 #include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
 #include <kdl/jntarray.hpp>
+#include <kdl/tree.hpp>
 #include <urdf/model.h>
 
 namespace Deterministic_TRAC_IK {
@@ -19,6 +23,15 @@ bool LoadModelOverride(
     const std::string& robot_description,
     urdf::Model& model);
 
+/// Return the KDL tree of \p model, or null if it cannot be parsed. Each
+/// distinct model, as told by ModelSignature(), is parsed once per process
+/// and the tree is shared by all callers. Safe to call from several threads.
+std::shared_ptr<const KDL::Tree> GetKDLTree(const urdf::ModelInterface& model);
+
+/// Extract the chain from \p base_name to \p tip_name, appending the names
+/// of its links and movable joints to \p link_names and \p joint_names. The
+/// chain of each model and pair of frames is extracted once per process, from
+/// the tree shared through GetKDLTree().
 bool InitKDLChain(
     const urdf::ModelInterface& model,
     const std::string& base_name,
@@ -29,6 +42,46 @@ bool InitKDLChain(
     KDL::JntArray& joint_min,
     KDL::JntArray& joint_max);
 
+/// Build the union of the chains from \p base_name to each of \p tip_names.
+/// The links and joints are listed in the order they are met walking the
+/// chain to each tip in turn, skipping those already met; this is the joint
+/// order expected by TreeIkSolver.
+bool InitKDLTree(
+    const urdf::ModelInterface& model,
+    const std::string& base_name,
+    const std::vector<std::string>& tip_names,
+    KDL::Tree& tree,
+    std::vector<std::string>& link_names,
+    std::vector<std::string>& joint_names,
+    KDL::JntArray& joint_min,
+    KDL::JntArray& joint_max);
+
+/// Open \p path, creating it if needed, and lock it exclusively with flock.
+/// Retries if the file was replaced while waiting for the lock, so that the
+/// locked file is the one at \p path. Returns the descriptor, or -1.
+int OpenLocked(const std::string& path);
+
+/// 64-bit FNV-1a hash of a byte range. Pass the result of a previous call as
+/// \p hash to hash several ranges in sequence.
+uint64_t HashBytes(
+    const void* data,
+    size_t size,
+    uint64_t hash = 14695981039346656037ULL);
+
+/// Hash of an IK query: the seed configuration, the target frame, and its
+/// bounds. Pass the result of a previous call as \p hash to combine several.
+uint64_t HashQuery(
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    const KDL::Twist& bounds,
+    uint64_t hash = 14695981039346656037ULL);
+
+/// Hash of everything in \p model that InitKDLChain() and InitKDLTree() read:
+/// the name, type, links, origin, axis, and limits of each joint. Models
+/// that only differ in other ways, e.g. in their inertia or geometry, have
+/// the same kinematics and share a signature.
+uint64_t ModelSignature(const urdf::ModelInterface& model);
+
 } // namespace Deterministic_TRAC_IK
 
 namespace KDL {
@@ -0,0 +1,213 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef KDLVELSOLVER_HPP
+#define KDLVELSOLVER_HPP
+
+// standard includes
+#include <memory>
+
+// system includes
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+#include <Eigen/SVD>
+
+namespace KDL {
+
+/// A Jacobian of at most 6 task rows, stored without heap allocation of the
+/// row dimension.
+template <typename Scalar>
+using TaskJacobianT = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor, 6, Eigen::Dynamic>;
+typedef TaskJacobianT<double> TaskJacobian;
+
+/// A task-space displacement of at most 6 components.
+template <typename Scalar>
+using TaskVectorT = Eigen::Matrix<Scalar, Eigen::Dynamic, 1, Eigen::ColMajor, 6, 1>;
+typedef TaskVectorT<double> TaskVector;
+
+enum VelSolverType
+{
+    VelSolverPinv,      // SVD pseudo-inverse
+    VelSolverDLS,       // damped least squares
+    VelSolverTranspose  // Jacobian transpose
+};
+
+/// Damping that is zero away from singularities and grows smoothly to
+/// max_damping as the singularity measure sigma approaches zero, following
+/// Maciejewski & Klein, "Numerical filtering for the operation of robotic
+/// manipulators through kinematically singular configurations", 1988.
+/// max_damping defaults to 0, i.e. no damping; see DefaultDamping for the
+/// damping each velocity solver starts with.
+struct AdaptiveDamping
+{
+    double threshold;
+    double max_damping;
+
+    AdaptiveDamping(double threshold = 0.05, double max_damping = 0.0) :
+        threshold(threshold), max_damping(max_damping)
+    { }
+
+    /// Return the squared damping factor for the singularity measure sigma.
+    double squared(double sigma) const
+    {
+        if (sigma >= threshold) {
+            return 0.0;
+        }
+        const double r = sigma / threshold;
+        return max_damping * max_damping * (1.0 - r * r);
+    }
+};
+
+/// Return the damping a velocity solver of \p type starts with. The pinv
+/// solver is undamped, so that it matches KDL::ChainIkSolverVel_pinv; the
+/// others need damping to stay well-defined when J J^T is singular, as it
+/// is for chains of fewer than 6 joints.
+inline AdaptiveDamping DefaultDamping(VelSolverType type)
+{
+    return type == VelSolverPinv ? AdaptiveDamping() : AdaptiveDamping(0.05, 0.1);
+}
+
+/// Strategy for computing the joint displacement that produces a desired
+/// task-space displacement, given the Jacobian at the current configuration.
+/// Instantiated for float and double.
+template <typename Scalar>
+class VelSolverT
+{
+public:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> JointVector;
+
+    virtual ~VelSolverT() { }
+
+    void setDamping(const AdaptiveDamping& damping) { damping_ = damping; }
+    const AdaptiveDamping& damping() const { return damping_; }
+
+    /// Compute \p qdot such that jac * qdot approximates \p v.
+    virtual void solve(
+        const TaskJacobianT<Scalar>& jac,
+        const TaskVectorT<Scalar>& v,
+        JointVector& qdot) = 0;
+
+protected:
+
+    AdaptiveDamping damping_;
+};
+
+typedef VelSolverT<double> VelSolver;
+
+/// Pseudo-inverse via SVD, with singular values below the damping threshold
+/// damped rather than inverted directly. Equivalent to
+/// KDL::ChainIkSolverVel_pinv away from singularities.
+template <typename Scalar>
+class PinvVelSolverT : public VelSolverT<Scalar>
+{
+public:
+
+    typedef typename VelSolverT<Scalar>::JointVector JointVector;
+
+    explicit PinvVelSolverT(unsigned int nj);
+
+    void solve(
+        const TaskJacobianT<Scalar>& jac,
+        const TaskVectorT<Scalar>& v,
+        JointVector& qdot) override;
+
+private:
+
+    Eigen::JacobiSVD<TaskJacobianT<Scalar>> svd_;
+    TaskVectorT<Scalar> tmp_;
+};
+
+typedef PinvVelSolverT<double> PinvVelSolver;
+
+/// Damped least squares, qdot = J^T (J J^T + lambda^2 I)^-1 v, solved with a
+/// fixed-size LDLT of the task-space matrix. The damping factor is chosen
+/// from the smallest eigenvalue of J J^T, computed only if damping is
+/// enabled.
+template <typename Scalar>
+class DLSVelSolverT : public VelSolverT<Scalar>
+{
+public:
+
+    typedef typename VelSolverT<Scalar>::JointVector JointVector;
+
+    explicit DLSVelSolverT(unsigned int nj);
+
+    void solve(
+        const TaskJacobianT<Scalar>& jac,
+        const TaskVectorT<Scalar>& v,
+        JointVector& qdot) override;
+
+private:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor, 6, 6> TaskMatrix;
+
+    TaskMatrix jjt_;
+    Eigen::LDLT<TaskMatrix> ldlt_;
+    Eigen::SelfAdjointEigenSolver<TaskMatrix> eig_;
+    TaskVectorT<Scalar> tmp_;
+};
+
+typedef DLSVelSolverT<double> DLSVelSolver;
+
+/// Jacobian transpose with the step length that minimizes the linearized
+/// error, alpha = <v, J J^T v> / (|J J^T v|^2 + lambda^2).
+template <typename Scalar>
+class TransposeVelSolverT : public VelSolverT<Scalar>
+{
+public:
+
+    typedef typename VelSolverT<Scalar>::JointVector JointVector;
+
+    explicit TransposeVelSolverT(unsigned int nj);
+
+    void solve(
+        const TaskJacobianT<Scalar>& jac,
+        const TaskVectorT<Scalar>& v,
+        JointVector& qdot) override;
+
+private:
+
+    TaskVectorT<Scalar> jjtv_;
+};
+
+typedef TransposeVelSolverT<double> TransposeVelSolver;
+
+template <typename Scalar>
+std::unique_ptr<VelSolverT<Scalar>> MakeVelSolverT(VelSolverType type, unsigned int nj);
+
+inline std::unique_ptr<VelSolver> MakeVelSolver(VelSolverType type, unsigned int nj)
+{
+    return MakeVelSolverT<double>(type, nj);
+}
+
+} // namespace KDL
+
+#endif
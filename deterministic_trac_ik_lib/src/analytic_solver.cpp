@@ -0,0 +1,164 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/analytic_solver.hpp>
+
+// standard includes
+#include <cmath>
+
+// system includes
+#include <dlfcn.h>
+#include <ros/ros.h>
+
+// project includes
+#include <deterministic_trac_ik/compiled_chain.hpp>
+#include <deterministic_trac_ik/utils.h>
+
+namespace Deterministic_TRAC_IK {
+
+static uint64_t HashValue(double value, uint64_t hash)
+{
+    // round away noise from URDF parsing; +0.0 folds negative zero
+    const int64_t q = (int64_t)std::llround(value * 1e6 + 0.0);
+    return HashBytes(&q, sizeof(q), hash);
+}
+
+static uint64_t HashFrame(const KDL::Frame& f, uint64_t hash)
+{
+    for (int i = 0; i < 3; ++i) {
+        hash = HashValue(f.p(i), hash);
+    }
+    for (int i = 0; i < 9; ++i) {
+        hash = HashValue(f.M.data[i], hash);
+    }
+    return hash;
+}
+
+uint64_t ChainSignature(const KDL::Chain& chain)
+{
+    // hash the fused form with only the kind of each joint, so that fixed
+    // links and joint type aliases, e.g. RotZ and RotAxis about z, do not
+    // change the signature
+    const KDL::Chain fused = FuseFixedSegments(chain);
+
+    uint64_t hash = HashBytes(nullptr, 0);
+    for (unsigned int i = 0; i < fused.getNrOfSegments(); ++i) {
+        const KDL::Segment& segment = fused.getSegment(i);
+        const KDL::Joint& joint = segment.getJoint();
+
+        int32_t type = 0;
+        switch (joint.getType()) {
+        case KDL::Joint::None:
+            type = 0;
+            break;
+        case KDL::Joint::TransAxis:
+        case KDL::Joint::TransX:
+        case KDL::Joint::TransY:
+        case KDL::Joint::TransZ:
+            type = 2;
+            break;
+        default:
+            type = 1;
+            break;
+        }
+        hash = HashBytes(&type, sizeof(type), hash);
+        if (joint.getType() != KDL::Joint::None) {
+            const KDL::Vector axis = joint.JointAxis();
+            const KDL::Vector origin = joint.JointOrigin();
+            for (int j = 0; j < 3; ++j) {
+                hash = HashValue(axis(j), hash);
+                hash = HashValue(origin(j), hash);
+            }
+        }
+
+        hash = HashFrame(segment.getFrameToTip(), hash);
+    }
+    return hash;
+}
+
+const char* AnalyticSolverRegistry::RegisterSymbol = "deterministic_trac_ik_register_solvers";
+
+AnalyticSolverRegistry& AnalyticSolverRegistry::instance()
+{
+    static AnalyticSolverRegistry registry;
+    return registry;
+}
+
+void AnalyticSolverRegistry::add(
+    uint64_t signature,
+    const AnalyticSolverFactory& factory)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    factories_[signature] = factory;
+}
+
+std::shared_ptr<AnalyticSolver> AnalyticSolverRegistry::create(
+    const KDL::Chain& chain) const
+{
+    const uint64_t signature = ChainSignature(chain);
+
+    AnalyticSolverFactory factory;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = factories_.find(signature);
+        if (it == factories_.end()) {
+            ROS_DEBUG_NAMED("deterministic_trac_ik", "No analytic solver for chain signature %016llx", (unsigned long long)signature);
+            return std::shared_ptr<AnalyticSolver>();
+        }
+        factory = it->second;
+    }
+
+    return factory(chain);
+}
+
+bool AnalyticSolverRegistry::load(const std::string& path)
+{
+    void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to load analytic solver library '%s': %s", path.c_str(), dlerror());
+        return false;
+    }
+
+    typedef void (*RegisterFunction)(AnalyticSolverRegistry&);
+    RegisterFunction reg = (RegisterFunction)dlsym(library, RegisterSymbol);
+    if (!reg) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Analytic solver library '%s' does not export %s", path.c_str(), RegisterSymbol);
+        dlclose(library);
+        return false;
+    }
+
+    reg(*this);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    libraries_.push_back(library);
+    return true;
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -0,0 +1,180 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/chain_fk_jac.hpp>
+
+// system includes
+#include <Eigen/Geometry>
+
+namespace KDL {
+
+ChainFkJacSolver::ChainFkJacSolver(const Chain& chain)
+:
+    chain_(chain),
+    ref_points_(chain.getNrOfJoints())
+{
+}
+
+int ChainFkJacSolver::JntToCartJac(const JntArray& q, Frame& p_out, Jacobian& jac)
+{
+    if (q.rows() != chain_.getNrOfJoints() ||
+        jac.columns() != chain_.getNrOfJoints())
+    {
+        return -1;
+    }
+
+    Frame T_base_tip = Frame::Identity();
+
+    unsigned int j = 0;
+    for (const Segment& segment : chain_.segments) {
+        if (segment.getJoint().getType() == Joint::None) {
+            T_base_tip = T_base_tip * segment.pose(0.0);
+            continue;
+        }
+
+        // unit twist of the joint, expressed in the base frame with its
+        // reference point at the tip of this segment
+        jac.setColumn(j, T_base_tip.M * segment.twist(q(j), 1.0));
+
+        T_base_tip = T_base_tip * segment.pose(q(j));
+        ref_points_[j] = T_base_tip.p;
+        ++j;
+    }
+
+    // move the reference point of every column to the tip of the chain in
+    // one pass, rather than shifting all columns at each segment
+    for (unsigned int k = 0; k < j; ++k) {
+        jac.setColumn(k, jac.getColumn(k).RefPoint(T_base_tip.p - ref_points_[k]));
+    }
+
+    p_out = T_base_tip;
+    return 0;
+}
+
+template <typename Scalar>
+ChainFkJacKernel<Scalar>::ChainFkJacKernel(const Chain& chain)
+{
+    // the pose of a segment is the screw motion of its joint followed by
+    // its pose at zero, which is folded into the next transform
+    Frame pending = Frame::Identity();
+    for (const Segment& segment : chain.segments) {
+        const Joint& joint = segment.getJoint();
+        if (joint.getType() == Joint::None) {
+            pending = pending * segment.pose(0.0);
+            continue;
+        }
+
+        Link link;
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                link.R(r, c) = Scalar(pending.M(r, c));
+            }
+            link.p(r) = Scalar(pending.p(r));
+            link.axis(r) = Scalar(joint.JointAxis()(r));
+            link.origin(r) = Scalar(joint.JointOrigin()(r));
+        }
+        link.rotational = joint.getType() != Joint::TransAxis &&
+                joint.getType() != Joint::TransX &&
+                joint.getType() != Joint::TransY &&
+                joint.getType() != Joint::TransZ;
+        links_.push_back(link);
+
+        pending = segment.pose(0.0);
+    }
+
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            tail_R_(r, c) = Scalar(pending.M(r, c));
+        }
+        tail_p_(r) = Scalar(pending.p(r));
+    }
+
+    ref_points_.resize(links_.size());
+}
+
+template <typename Scalar>
+int ChainFkJacKernel<Scalar>::JntToCartJac(
+    const JntArray& q,
+    Frame& p_out,
+    Jacobian& jac)
+{
+    if (q.rows() != links_.size()) {
+        return -1;
+    }
+    jac.resize(6, links_.size());
+
+    Matrix3 R = Matrix3::Identity();
+    Vector3 p = Vector3::Zero();
+
+    for (size_t j = 0; j < links_.size(); ++j) {
+        const Link& link = links_[j];
+        p += R * link.p;
+        R = R * link.R;
+
+        const Vector3 w = R * link.axis;
+        const Scalar qj = Scalar(q(j));
+        if (link.rotational) {
+            // rotation about the axis through the joint origin
+            const Matrix3 Rq = Eigen::AngleAxis<Scalar>(qj, link.axis).toRotationMatrix();
+            ref_points_[j] = R * link.origin + p;
+            p += R * (link.origin - Rq * link.origin);
+            R = R * Rq;
+            jac.col(j).template tail<3>() = w;
+        } else {
+            p += R * (link.axis * qj);
+            jac.col(j).template head<3>() = w;
+            jac.col(j).template tail<3>().setZero();
+        }
+    }
+
+    p += R * tail_p_;
+    R = R * tail_R_;
+
+    // a revolute joint moves the tip about its axis
+    for (size_t j = 0; j < links_.size(); ++j) {
+        if (links_[j].rotational) {
+            const Vector3 w = jac.col(j).template tail<3>();
+            jac.col(j).template head<3>() = w.cross(p - ref_points_[j]);
+        }
+    }
+
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            p_out.M(r, c) = double(R(r, c));
+        }
+        p_out.p(r) = double(p(r));
+    }
+    return 0;
+}
+
+template class ChainFkJacKernel<float>;
+template class ChainFkJacKernel<double>;
+
+} // namespace KDL
@@ -0,0 +1,362 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/compiled_chain.hpp>
+
+// standard includes
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// system includes
+#include <fcntl.h>
+#include <ros/ros.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Deterministic_TRAC_IK {
+
+static const char ChainMagic[8] = { 'D', 'T', 'I', 'K', 'C', 'H', 'N', '\0' };
+static const uint32_t ChainVersion = 1;
+
+// file layout: Header, SegmentRecord[num_segments], double q_min[num_joints],
+// double q_max[num_joints], uint32_t joint_names[num_joints], and a table of
+// NUL-terminated strings referenced by offset
+struct CompiledChain::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_segments;
+    uint32_t num_joints;
+    uint32_t reserved;
+    uint64_t source_key;
+    uint64_t strings_size;
+};
+
+struct CompiledChain::SegmentRecord
+{
+    int32_t type; // 0 for a fixed joint, 1 for revolute, 2 for prismatic
+    uint32_t name;
+    uint32_t joint_name;
+    uint32_t reserved;
+    double origin[3];
+    double axis[3];
+    double p[3];
+    double M[9];
+};
+
+static bool IsRotational(KDL::Joint::JointType type)
+{
+    return type == KDL::Joint::RotAxis ||
+            type == KDL::Joint::RotX ||
+            type == KDL::Joint::RotY ||
+            type == KDL::Joint::RotZ;
+}
+
+KDL::Chain FuseFixedSegments(const KDL::Chain& chain)
+{
+    std::vector<KDL::Segment> segments;
+    for (unsigned int i = 0; i < chain.getNrOfSegments(); ++i) {
+        const KDL::Segment& segment = chain.getSegment(i);
+        if (segment.getJoint().getType() == KDL::Joint::None && !segments.empty()) {
+            const KDL::Segment prev = segments.back();
+            segments.back() = KDL::Segment(
+                    segment.getName(),
+                    prev.getJoint(),
+                    prev.getFrameToTip() * segment.getFrameToTip());
+        } else {
+            segments.push_back(segment);
+        }
+    }
+
+    KDL::Chain fused;
+    for (const KDL::Segment& segment : segments) {
+        fused.addSegment(segment);
+    }
+    return fused;
+}
+
+CompiledChain::CompiledChain() : valid_(false)
+{
+}
+
+CompiledChain::CompiledChain(
+    const KDL::Chain& chain,
+    const std::vector<std::string>& joint_names,
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max)
+:
+    valid_(false),
+    q_min_(q_min),
+    q_max_(q_max)
+{
+    if (joint_names.size() != chain.getNrOfJoints() ||
+        q_min.rows() != chain.getNrOfJoints() ||
+        q_max.rows() != chain.getNrOfJoints())
+    {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Joint names and limits do not match the chain");
+        return;
+    }
+
+    const KDL::Chain fused = FuseFixedSegments(chain);
+    for (unsigned int i = 0; i < fused.getNrOfSegments(); ++i) {
+        const KDL::Segment& segment = fused.getSegment(i);
+        const KDL::Joint& joint = segment.getJoint();
+
+        SegmentData data;
+        data.name = segment.getName();
+        data.joint_name = joint.getName();
+        if (joint.getType() == KDL::Joint::None) {
+            data.type = KDL::Joint::None;
+            data.origin = KDL::Vector::Zero();
+            data.axis = KDL::Vector::Zero();
+        } else {
+            data.type = IsRotational(joint.getType()) ? KDL::Joint::RotAxis : KDL::Joint::TransAxis;
+            data.origin = joint.JointOrigin();
+            data.axis = joint.JointAxis();
+        }
+        data.f_tip = segment.getFrameToTip();
+        segments_.push_back(data);
+    }
+
+    joint_names_ = joint_names;
+    buildChain();
+}
+
+void CompiledChain::buildChain()
+{
+    chain_ = KDL::Chain();
+    link_names_.clear();
+    for (const SegmentData& data : segments_) {
+        const KDL::Joint joint = data.type == KDL::Joint::None ?
+                KDL::Joint(data.joint_name, KDL::Joint::None) :
+                KDL::Joint(data.joint_name, data.origin, data.axis, data.type);
+        chain_.addSegment(KDL::Segment(data.name, joint, data.f_tip));
+        link_names_.push_back(data.name);
+    }
+
+    joint_types_ = KDL::ClassifyJoints(chain_, q_min_, q_max_);
+    valid_ = true;
+}
+
+bool CompiledChain::save(const std::string& path, uint64_t source_key) const
+{
+    if (!valid()) {
+        return false;
+    }
+
+    std::string strings;
+    auto add_string = [&strings](const std::string& s) -> uint32_t
+    {
+        const uint32_t offset = (uint32_t)strings.size();
+        strings.append(s.c_str(), s.size() + 1);
+        return offset;
+    };
+
+    std::vector<SegmentRecord> records(segments_.size());
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        const SegmentData& data = segments_[i];
+        SegmentRecord& record = records[i];
+        std::memset(&record, 0, sizeof(record));
+        record.type = data.type == KDL::Joint::None ? 0 : (data.type == KDL::Joint::RotAxis ? 1 : 2);
+        record.name = add_string(data.name);
+        record.joint_name = add_string(data.joint_name);
+        for (int j = 0; j < 3; ++j) {
+            record.origin[j] = data.origin(j);
+            record.axis[j] = data.axis(j);
+            record.p[j] = data.f_tip.p(j);
+        }
+        for (int j = 0; j < 9; ++j) {
+            record.M[j] = data.f_tip.M.data[j];
+        }
+    }
+
+    std::vector<uint32_t> joint_names(joint_names_.size());
+    for (size_t i = 0; i < joint_names_.size(); ++i) {
+        joint_names[i] = add_string(joint_names_[i]);
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ChainMagic, sizeof(ChainMagic));
+    header.version = ChainVersion;
+    header.num_segments = (uint32_t)records.size();
+    header.num_joints = (uint32_t)joint_names.size();
+    header.source_key = source_key;
+    header.strings_size = strings.size();
+
+    // write next to the destination and rename, so that concurrent readers
+    // never see a partial file
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open compiled chain file '%s' for writing", tmp_path.c_str());
+            return false;
+        }
+
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)records.data(), records.size() * sizeof(SegmentRecord));
+        out.write((const char*)q_min_.data.data(), q_min_.rows() * sizeof(double));
+        out.write((const char*)q_max_.data.data(), q_max_.rows() * sizeof(double));
+        out.write((const char*)joint_names.data(), joint_names.size() * sizeof(uint32_t));
+        out.write(strings.data(), strings.size());
+        if (!out) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to write compiled chain file '%s'", tmp_path.c_str());
+            return false;
+        }
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to replace compiled chain file '%s': %s", path.c_str(), std::strerror(errno));
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CompiledChain::load(const std::string& path, uint64_t source_key)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "No compiled chain file '%s'", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+        ROS_WARN_NAMED("deterministic_trac_ik", "Compiled chain file '%s' is truncated", path.c_str());
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        ROS_WARN_NAMED("deterministic_trac_ik", "Failed to map compiled chain file '%s'", path.c_str());
+        return false;
+    }
+
+    const char* base = (const char*)mapping;
+    const Header& header = *(const Header*)base;
+    const size_t num_segments = header.num_segments;
+    const size_t num_joints = header.num_joints;
+    const size_t records_offset = sizeof(Header);
+    const size_t limits_offset = records_offset + num_segments * sizeof(SegmentRecord);
+    const size_t names_offset = limits_offset + 2 * num_joints * sizeof(double);
+    const size_t strings_offset = names_offset + num_joints * sizeof(uint32_t);
+
+    if (std::memcmp(header.magic, ChainMagic, sizeof(ChainMagic)) != 0 ||
+        header.version != ChainVersion ||
+        num_segments > (size_t)st.st_size / sizeof(SegmentRecord) ||
+        num_joints > num_segments ||
+        header.strings_size == 0 ||
+        (uint64_t)st.st_size != strings_offset + header.strings_size ||
+        base[st.st_size - 1] != '\0')
+    {
+        ROS_WARN_NAMED("deterministic_trac_ik", "'%s' is not a valid compiled chain", path.c_str());
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    if (header.source_key != source_key) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "Compiled chain file '%s' is stale", path.c_str());
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    const SegmentRecord* records = (const SegmentRecord*)(base + records_offset);
+    const double* limits = (const double*)(base + limits_offset);
+    const uint32_t* joint_names = (const uint32_t*)(base + names_offset);
+    const char* strings = base + strings_offset;
+
+    const KDL::Joint::JointType types[3] = { KDL::Joint::None, KDL::Joint::RotAxis, KDL::Joint::TransAxis };
+
+    std::vector<SegmentData> segments(num_segments);
+    std::vector<std::string> names(num_joints);
+    size_t joints = 0;
+    bool ok = true;
+    for (size_t i = 0; i < num_segments; ++i) {
+        const SegmentRecord& record = records[i];
+        SegmentData& data = segments[i];
+        if (record.name >= header.strings_size ||
+            record.joint_name >= header.strings_size ||
+            record.type < 0 || record.type > 2)
+        {
+            ok = false;
+            break;
+        }
+
+        data.name = strings + record.name;
+        data.joint_name = strings + record.joint_name;
+        data.type = types[record.type];
+        if (record.type != 0) {
+            ++joints;
+        }
+        data.origin = KDL::Vector(record.origin[0], record.origin[1], record.origin[2]);
+        data.axis = KDL::Vector(record.axis[0], record.axis[1], record.axis[2]);
+        data.f_tip = KDL::Frame(
+                KDL::Rotation(
+                        record.M[0], record.M[1], record.M[2],
+                        record.M[3], record.M[4], record.M[5],
+                        record.M[6], record.M[7], record.M[8]),
+                KDL::Vector(record.p[0], record.p[1], record.p[2]));
+    }
+    for (size_t i = 0; ok && i < num_joints; ++i) {
+        if (joint_names[i] >= header.strings_size) {
+            ok = false;
+            break;
+        }
+        names[i] = strings + joint_names[i];
+    }
+
+    if (!ok || joints != num_joints) {
+        ROS_WARN_NAMED("deterministic_trac_ik", "'%s' is not a valid compiled chain", path.c_str());
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    q_min_.resize(num_joints);
+    q_max_.resize(num_joints);
+    for (size_t i = 0; i < num_joints; ++i) {
+        q_min_(i) = limits[i];
+        q_max_(i) = limits[num_joints + i];
+    }
+    munmap(mapping, st.st_size);
+
+    segments_.swap(segments);
+    joint_names_.swap(names);
+    buildChain();
+    return true;
+}
+
+} // namespace Deterministic_TRAC_IK
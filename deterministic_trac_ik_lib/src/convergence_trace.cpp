@@ -0,0 +1,118 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/convergence_trace.hpp>
+
+// standard includes
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+// system includes
+#include <ros/ros.h>
+
+namespace Deterministic_TRAC_IK {
+
+ConvergenceTrace::ConvergenceTrace(size_t capacity) :
+    entries_(std::max<size_t>(capacity, 1)),
+    count_(0),
+    queries_(0)
+{
+}
+
+size_t ConvergenceTrace::size() const
+{
+    return std::min<uint64_t>(count_, entries_.size());
+}
+
+void ConvergenceTrace::record(
+    const char* solver,
+    uint64_t step,
+    double residual,
+    bool restarted,
+    bool clamped)
+{
+    TraceEntry& entry = entries_[count_ % entries_.size()];
+    entry.query = queries_;
+    entry.solver = solver;
+    entry.step = step;
+    entry.residual = residual;
+    entry.restarted = restarted;
+    entry.clamped = clamped;
+    ++count_;
+}
+
+std::vector<TraceEntry> ConvergenceTrace::entries() const
+{
+    std::vector<TraceEntry> entries;
+    entries.reserve(size());
+    for (uint64_t i = count_ - size(); i < count_; ++i) {
+        entries.push_back(entries_[i % entries_.size()]);
+    }
+    return entries;
+}
+
+void ConvergenceTrace::clear()
+{
+    count_ = 0;
+    queries_ = 0;
+}
+
+void ConvergenceTrace::writeCSV(std::ostream& os) const
+{
+    os.precision(std::numeric_limits<double>::max_digits10);
+    os << "query,solver,step,residual,restarted,clamped\n";
+    for (const TraceEntry& entry : entries()) {
+        os << entry.query << ','
+           << entry.solver << ','
+           << entry.step << ','
+           << entry.residual << ','
+           << (int)entry.restarted << ','
+           << (int)entry.clamped << '\n';
+    }
+}
+
+bool ConvergenceTrace::saveCSV(const std::string& path) const
+{
+    std::ofstream ofs(path.c_str());
+    if (!ofs) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open trace file '%s'", path.c_str());
+        return false;
+    }
+
+    writeCSV(ofs);
+    if (!ofs) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to write trace file '%s'", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -31,7 +31,9 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <deterministic_trac_ik/deterministic_trac_ik.hpp>
 
 // standard includes
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <limits>
 
 // system includes
@@ -71,43 +73,166 @@ Deterministic_TRAC_IK::Deterministic_TRAC_IK(
     joint_min_(q_min),
     joint_max_(q_max),
     joint_types_(),
+    search_min_(q_min),
+    search_max_(q_max),
+    search_types_(),
+    consistency_limited_(false),
+    rng_(),
+    per_query_seeding_(false),
+    seed_salt_(0),
     jac_solver_(chain),
+    fk_solver_(chain_),
     nl_solver_(chain, q_min, q_max, eps, NLOPT_IK::SumSq),
     ik_solver_(chain, q_min, q_max, eps, true, true),
+    solvers_(),
     bounds_(KDL::Twist::Zero()),
     eps_(eps),
+    candidate_eps_(0.0),
     solve_type_(type),
     max_iters_(max_iterations),
+    iterations_(0),
+    cost_model_(),
+    cost_budget_(0.0),
+    cost_(0.0),
+    work_charged_(),
     solutions_(),
     errors_(),
-    seed_(chain.getNrOfJoints())
+    rejected_(),
+    seed_(chain.getNrOfJoints()),
+    cache_(),
+    reachability_map_(),
+    analytic_solver_(AnalyticSolverRegistry::instance().create(chain)),
+    analytic_solutions_(),
+    query_log_(),
+    trace_()
 {
     assert(chain_.getNrOfJoints() == joint_min_.data.size());
     assert(chain_.getNrOfJoints() == joint_max_.data.size());
 
-    for (uint i = 0; i < chain_.segments.size(); i++) {
-        std::string type = chain_.segments[i].getJoint().getTypeName();
-        if (type.find("Rot") != std::string::npos) {
-            if (joint_max_(joint_types_.size()) >= std::numeric_limits<float>::max() &&
-                joint_min_(joint_types_.size()) <= std::numeric_limits<float>::lowest())
-            {
-                joint_types_.push_back(KDL::BasicJointType::Continuous);
-            } else {
-                joint_types_.push_back(KDL::BasicJointType::RotJoint);
-            }
-        } else if (type.find("Trans") != std::string::npos) {
-            joint_types_.push_back(KDL::BasicJointType::TransJoint);
-        }
+    joint_types_ = KDL::ClassifyJoints(chain_, joint_min_, joint_max_);
+
+    search_types_ = joint_types_;
+
+    // KDLSolver, NLOptSolver
+    solvers_.push_back({ &ik_solver_, nullptr, true, eps, false, 0 });
+    solvers_.push_back({ &nl_solver_, nullptr, true, eps, false, 0 });
+}
+
+size_t Deterministic_TRAC_IK::addSolver(
+    const std::shared_ptr<IterativeIkSolver>& solver)
+{
+    solver->setBounds(bounds_);
+    solver->setRestartPolicy(restart_policy_);
+    solver->setTrace(trace_);
+    solvers_.push_back({ solver.get(), solver, true, solver->eps(), false, 0 });
+    return solvers_.size() - 1;
+}
+
+void Deterministic_TRAC_IK::setRestartPolicy(const RestartPolicy& policy)
+{
+    restart_policy_ = policy;
+    for (auto& entry : solvers_) {
+        entry.solver->setRestartPolicy(policy);
+    }
+}
+
+SolverOptions Deterministic_TRAC_IK::getSolverOptions() const
+{
+    SolverOptions options;
+    options.singularity_threshold = getDamping().threshold;
+    options.max_damping = getDamping().max_damping;
+    options.nullspace_gain = getNullSpaceGain();
+    options.nlopt_xtol = getNLOptXTolAbs();
+    options.coarse_eps = getCoarseEps();
+    options.candidate_eps = candidate_eps_;
+    options.stagnation_threshold = stagnation_.threshold;
+    options.stagnation_min_improvement = stagnation_.min_improvement;
+    options.restart_plateau_improvement = restart_policy_.plateau_improvement;
+    options.restart_perturbation = restart_policy_.perturbation;
+    options.cost_fk = cost_model_.fk;
+    options.cost_jacobian = cost_model_.jacobian;
+    options.cost_svd = cost_model_.svd;
+    options.vel_solver = getVelSolver();
+    options.nullspace_objective = getNullSpaceObjective();
+    options.nlopt_type = getNLOptType();
+    options.nlopt_algorithm = getNLOptAlgorithm();
+    options.line_search = getLineSearch();
+    options.active_set = getActiveSet();
+    options.stagnation_patience = stagnation_.patience;
+    options.restart_plateau_window = restart_policy_.plateau_window;
+    options.restart_max_steps = restart_policy_.max_steps;
+    options.restart_sampling = restart_policy_.sampling;
+    options.external =
+            (cache_ ? SolverOptions::Cache : 0) |
+            (reachability_map_ ? SolverOptions::ReachabilityMap : 0) |
+            (analytic_solver_ ? SolverOptions::AnalyticSolver : 0);
+    return options;
+}
+
+void Deterministic_TRAC_IK::setSolverOptions(const SolverOptions& options)
+{
+    setVelSolver((KDL::VelSolverType)options.vel_solver);
+    setDamping(KDL::AdaptiveDamping(options.singularity_threshold, options.max_damping));
+    setNullSpaceObjective((KDL::NullSpaceObjective)options.nullspace_objective, options.nullspace_gain);
+    setNLOptType((NLOPT_IK::OptType)options.nlopt_type);
+    setNLOptAlgorithm((nlopt::algorithm)options.nlopt_algorithm);
+    setNLOptXTolAbs(options.nlopt_xtol);
+    setCoarseEps(options.coarse_eps);
+    setLineSearch(options.line_search);
+    setActiveSet(options.active_set != 0);
+    setCandidateEps(options.candidate_eps);
+
+    StagnationPolicy stagnation;
+    stagnation.patience = options.stagnation_patience;
+    stagnation.threshold = options.stagnation_threshold;
+    stagnation.min_improvement = options.stagnation_min_improvement;
+    setStagnationPolicy(stagnation);
+
+    RestartPolicy restart;
+    restart.plateau_window = options.restart_plateau_window;
+    restart.plateau_improvement = options.restart_plateau_improvement;
+    restart.max_steps = options.restart_max_steps;
+    restart.sampling = (RestartPolicy::Sampling)options.restart_sampling;
+    restart.perturbation = options.restart_perturbation;
+    setRestartPolicy(restart);
+
+    CostModel cost_model;
+    cost_model.fk = options.cost_fk;
+    cost_model.jacobian = options.cost_jacobian;
+    cost_model.svd = options.cost_svd;
+    setCostModel(cost_model);
+}
+
+void Deterministic_TRAC_IK::setTrace(const std::shared_ptr<ConvergenceTrace>& trace)
+{
+    trace_ = trace;
+    for (auto& entry : solvers_) {
+        entry.solver->setTrace(trace);
     }
+}
 
-    assert(joint_types_.size() == joint_min_.data.size());
+RestartCounters Deterministic_TRAC_IK::getRestartCounters() const
+{
+    RestartCounters counters;
+    for (const auto& entry : solvers_) {
+        counters += entry.solver->restartCounters();
+    }
+    return counters;
+}
+
+void Deterministic_TRAC_IK::resetRestartCounters()
+{
+    for (auto& entry : solvers_) {
+        entry.solver->resetRestartCounters();
+    }
 }
 
 void Deterministic_TRAC_IK::setBounds(const KDL::Twist& bounds)
 {
     bounds_ = bounds;
-    nl_solver_.setBounds(bounds);
-    ik_solver_.setBounds(bounds);
+    for (auto& entry : solvers_) {
+        entry.solver->setBounds(bounds);
+    }
 }
 
 bool Deterministic_TRAC_IK::unique_solution(const KDL::JntArray& sol)
@@ -121,9 +246,27 @@ bool Deterministic_TRAC_IK::unique_solution(const KDL::JntArray& sol)
             return false;
         }
     }
+    for (uint i = 0; i < rejected_.size(); i++) {
+        if (myEqual(sol, rejected_[i])) {
+            return false;
+        }
+    }
     return true;
 }
 
+bool Deterministic_TRAC_IK::accept_solution(
+    const KDL::JntArray& sol,
+    const SolutionFilter& filter)
+{
+    if (!filter || filter(sol)) {
+        return true;
+    }
+
+    ROS_DEBUG_NAMED("deterministic_trac_ik", "Solution rejected by filter");
+    rejected_.push_back(sol);
+    return false;
+}
+
 inline void normalizeAngle(double& val, const double& min, const double& max)
 {
     if (val > max) {
@@ -158,17 +301,56 @@ inline void normalizeAngle(double& val, const double& target)
     }
 }
 
+bool Deterministic_TRAC_IK::setConsistencyLimits(
+    const KDL::JntArray& q_init,
+    const KDL::JntArray& consistency_limits)
+{
+    assert(consistency_limits.data.size() == joint_min_.data.size());
+
+    for (size_t j = 0; j < joint_types_.size(); ++j) {
+        const double limit = std::abs(consistency_limits(j));
+        search_min_(j) = std::max(joint_min_(j), q_init(j) - limit);
+        search_max_(j) = std::min(joint_max_(j), q_init(j) + limit);
+        if (search_min_(j) > search_max_(j)) {
+            ROS_DEBUG_NAMED("deterministic_trac_ik", "Consistency limits for joint %zu are outside the joint limits", j);
+            resetConsistencyLimits();
+            return false;
+        }
+
+        if (joint_types_[j] == KDL::BasicJointType::Continuous) {
+            search_types_[j] = KDL::BasicJointType::RotJoint;
+        }
+    }
+
+    for (auto& entry : solvers_) {
+        entry.solver->setJointLimits(search_min_, search_max_);
+    }
+    consistency_limited_ = true;
+    return true;
+}
+
+void Deterministic_TRAC_IK::resetConsistencyLimits()
+{
+    search_min_ = joint_min_;
+    search_max_ = joint_max_;
+    search_types_ = joint_types_;
+    for (auto& entry : solvers_) {
+        entry.solver->resetJointLimits();
+    }
+    consistency_limited_ = false;
+}
+
 void Deterministic_TRAC_IK::randomize(KDL::JntArray& q, const KDL::JntArray& q_init)
 {
     for (size_t j = 0; j < q.data.size(); ++j) {
-        if (joint_types_[j] == KDL::BasicJointType::Continuous) {
+        if (search_types_[j] == KDL::BasicJointType::Continuous) {
             std::uniform_real_distribution<double> dist(
                     q_init(j) - 2.0 * M_PI, q_init(j) + 2.0 * M_PI);
             q(j) = dist(rng_);
         }
         else {
             std::uniform_real_distribution<double> dist(
-                    joint_min_(j), joint_max_(j));
+                    search_min_(j), search_max_(j));
             q(j) = dist(rng_);
         }
     }
@@ -179,10 +361,11 @@ void Deterministic_TRAC_IK::normalize_seed(
     KDL::JntArray& solution)
 {
     // Make sure rotational joint values are within 1 revolution of seed; then
-    // ensure joint limits are met.
+    // ensure the joint limits of the search, which include any consistency
+    // limits, are met.
 
     for (uint i = 0; i < joint_min_.data.size(); i++) {
-        if (joint_types_[i] == KDL::BasicJointType::TransJoint) {
+        if (search_types_[i] == KDL::BasicJointType::TransJoint) {
             continue;
         }
 
@@ -191,12 +374,12 @@ void Deterministic_TRAC_IK::normalize_seed(
 
         normalizeAngle(val, target);
 
-        if (joint_types_[i] == KDL::BasicJointType::Continuous) {
+        if (search_types_[i] == KDL::BasicJointType::Continuous) {
             solution(i) = val;
             continue;
         }
 
-        normalizeAngle(val, joint_min_(i), joint_max_(i));
+        normalizeAngle(val, search_min_(i), search_max_(i));
 
         solution(i) = val;
     }
@@ -207,31 +390,32 @@ void Deterministic_TRAC_IK::normalize_limits(
     KDL::JntArray& solution)
 {
     // Make sure rotational joint values are within 1 revolution of middle of
-    // limits; then ensure joint limits are met.
+    // the limits of the search, which include any consistency limits; then
+    // ensure those limits are met.
 
     for (uint i = 0; i < joint_min_.data.size(); i++) {
-        if (joint_types_[i] == KDL::BasicJointType::TransJoint) {
+        if (search_types_[i] == KDL::BasicJointType::TransJoint) {
             continue;
         }
 
         double target = seed(i);
 
-        if (joint_types_[i] == KDL::BasicJointType::RotJoint &&
-            joint_types_[i] != KDL::BasicJointType::Continuous)
+        if (search_types_[i] == KDL::BasicJointType::RotJoint &&
+            search_types_[i] != KDL::BasicJointType::Continuous)
         {
-            target = (joint_max_(i) + joint_min_(i)) / 2.0;
+            target = (search_max_(i) + search_min_(i)) / 2.0;
         }
 
         double val = solution(i);
 
         normalizeAngle(val, target);
 
-        if (joint_types_[i] == KDL::BasicJointType::Continuous) {
+        if (search_types_[i] == KDL::BasicJointType::Continuous) {
             solution(i) = val;
             continue;
         }
 
-        normalizeAngle(val, joint_min_(i), joint_max_(i));
+        normalizeAngle(val, search_min_(i), search_max_(i));
 
         solution(i) = val;
     }
@@ -283,49 +467,271 @@ int Deterministic_TRAC_IK::CartToJnt(
     const KDL::Frame &p_in,
     KDL::JntArray &q_out,
     const KDL::Twist& bounds)
+{
+    return CartToJnt(q_init, p_in, q_out, bounds, KDL::JntArray());
+}
+
+int Deterministic_TRAC_IK::CartToJnt(
+    const KDL::JntArray &q_init,
+    const KDL::Frame &p_in,
+    KDL::JntArray &q_out,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits,
+    const SolutionFilter& filter)
+{
+    iterations_ = 0;
+    cost_ = 0.0;
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    if (trace_) {
+        trace_->beginQuery();
+    }
+#endif
+
+    if (!query_log_) {
+        return solve_query(q_init, p_in, q_out, bounds, consistency_limits, filter);
+    }
+
+    auto before = std::chrono::steady_clock::now();
+    int rc = solve_query(q_init, p_in, q_out, bounds, consistency_limits, filter);
+    auto after = std::chrono::steady_clock::now();
+
+    record_query(
+            q_init, p_in, q_out, bounds, consistency_limits, filter, rc,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count());
+    return rc;
+}
+
+void Deterministic_TRAC_IK::record_query(
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    const KDL::JntArray& q_out,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits,
+    const SolutionFilter& filter,
+    int rc,
+    uint64_t duration_ns)
+{
+    QueryRecord record;
+    record.pose = p_in;
+    record.seed = q_init;
+    record.bounds = bounds;
+    record.consistency_limits = consistency_limits;
+    record.solve_type = solve_type_;
+    record.max_iterations = max_iters_;
+    record.eps = eps_;
+    record.per_query_seeding = per_query_seeding_;
+    record.seed_salt = seed_salt_;
+    record.cost_budget = cost_budget_;
+    record.filtered = (bool)filter;
+    record.result = rc;
+    if (rc >= 0) {
+        record.solution = q_out;
+    }
+    record.iterations = iterations_;
+    record.duration_ns = duration_ns;
+    query_log_->record(record);
+}
+
+int Deterministic_TRAC_IK::solve_query(
+    const KDL::JntArray &q_init,
+    const KDL::Frame &p_in,
+    KDL::JntArray &q_out,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits,
+    const SolutionFilter& filter)
+{
+    if (reachability_map_ && !reachability_map_->reachable(p_in, bounds)) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "Target is outside the reachability map");
+        return Unreachable;
+    }
+
+    if (!cache_ || filter) {
+        return search(q_init, p_in, q_out, bounds, consistency_limits, filter);
+    }
+
+    const IKCache::Key key = cache_->makeKey(
+            q_init, p_in, bounds, consistency_limits, solve_type_);
+
+    int rc;
+    auto accept = [&](const KDL::JntArray& q) {
+        return satisfies(q, q_init, p_in, bounds, consistency_limits);
+    };
+    if (cache_->lookup(key, q_out, rc, accept)) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "Returning cached solution");
+        return rc;
+    }
+
+    rc = search(q_init, p_in, q_out, bounds, consistency_limits, filter);
+
+    // only successes are cached since a hit must be verifiable against the
+    // requested pose
+    if (rc >= 0) {
+        cache_->insert(key, q_out, rc);
+    }
+
+    return rc;
+}
+
+bool Deterministic_TRAC_IK::satisfies(
+    const KDL::JntArray& q,
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits)
+{
+    if (q.data.size() != joint_min_.data.size()) {
+        return false;
+    }
+
+    for (unsigned int j = 0; j < q.data.size(); ++j) {
+        if (joint_types_[j] != KDL::BasicJointType::Continuous &&
+            (q(j) < joint_min_(j) || q(j) > joint_max_(j)))
+        {
+            return false;
+        }
+        if (consistency_limits.data.size() != 0 &&
+            std::abs(q(j) - q_init(j)) > std::abs(consistency_limits(j)))
+        {
+            return false;
+        }
+    }
+
+    KDL::Frame p;
+    if (fk_solver_.JntToCart(q, p) < 0) {
+        return false;
+    }
+
+    KDL::Twist delta_twist = KDL::diffRelative(p_in, p);
+    for (int i = 0; i < 6; i++) {
+        if (std::abs(delta_twist[i]) <= std::abs(bounds[i])) {
+            delta_twist[i] = 0.0;
+        }
+    }
+
+    return KDL::Equal(delta_twist, KDL::Twist::Zero(), eps_);
+}
+
+int Deterministic_TRAC_IK::search(
+    const KDL::JntArray &q_init,
+    const KDL::Frame &p_in,
+    KDL::JntArray &q_out,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits,
+    const SolutionFilter& filter)
 {
     solutions_.clear();
     errors_.clear();
+    rejected_.clear();
+
+    if (consistency_limits.data.size() != 0) {
+        if (!setConsistencyLimits(q_init, consistency_limits)) {
+            return NoSolution;
+        }
+    } else if (consistency_limited_) {
+        resetConsistencyLimits();
+    }
 
-    ik_solver_.setBounds(bounds);
-    nl_solver_.setBounds(bounds);
+    for (auto& entry : solvers_) {
+        entry.solver->setBounds(bounds);
+    }
+
+    if (per_query_seeding_) {
+        seedQuery(q_init, p_in, bounds, consistency_limits);
+    }
 
     for (unsigned int jidx = 0; jidx < chain_.getNrOfJoints(); ++jidx) {
         seed_(jidx) = q_init(jidx);
     }
 
-    ik_solver_.restart(seed_, p_in);
-    nl_solver_.restart(seed_, p_in);
+    if (analytic_solver_) {
+        int rc = searchAnalytic(q_init, p_in, q_out, bounds, consistency_limits, filter);
+        if (rc >= 0) {
+            return rc;
+        }
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "Analytic solver found no valid solution; falling back to numeric search");
+    }
+
+    work_charged_.resize(solvers_.size());
+    for (size_t i = 0; i < solvers_.size(); ++i) {
+        work_charged_[i] = solvers_[i].solver->work();
+    }
+
+    size_t solver = solvers_.size();
+    for (size_t i = 0; i < solvers_.size(); ++i) {
+        if (solvers_[i].enabled) {
+            solvers_[i].solver->restart(seed_, p_in);
+            if (solver == solvers_.size()) {
+                solver = i;
+            }
+        }
+    }
 
-    enum Solver {
-        SOLVER_KDL,
-        SOLVER_NLOPT,
+    if (solver == solvers_.size()) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "No solvers enabled");
+        return best_solution(q_out);
+    }
 
-        SOLVER_COUNT
+    stagnation_best_.assign(solvers_.size(), std::numeric_limits<double>::infinity());
+    stagnation_rounds_.assign(solvers_.size(), 0);
+
+    // let the solvers report candidates at the looser tolerance; only those
+    // that improve on the best solution so far are refined
+    const bool coarse = solve_type_ != Speed && candidate_eps_ > 0.0;
+    if (coarse) {
+        for (auto& entry : solvers_) {
+            entry.eps = entry.solver->eps();
+            entry.solver->setEps(std::max(entry.eps, candidate_eps_));
+            entry.refining = false;
+        }
+    }
+    auto restore_eps = [&]() {
+        if (coarse) {
+            for (auto& entry : solvers_) {
+                entry.solver->setEps(entry.eps);
+            }
+        }
     };
 
-    int solver = SOLVER_KDL;
-//    int solver = SOLVER_NLOPT;
+    // solutions from the pseudo-inverse solver are already pulled toward
+    // q_init, so the first one is taken as the closest
+    const bool stop_early =
+            solve_type_ == Distance &&
+            ik_solver_.nullSpaceObjective() == KDL::NullSpaceJointDistance;
+    bool stopped = false;
 
     const int step_size = 50;
     const int max_iters = max_iters_ / step_size;
-    for (int i = 0; i < max_iters; ++i) {
-        // interleave iterations of kdl and nl opt
-        switch (solver) {
-        case SOLVER_KDL: {
-            auto before = std::chrono::high_resolution_clock::now();
-            int rc = ik_solver_.step(step_size);
-            auto after = std::chrono::high_resolution_clock::now();
-            ROS_DEBUG_THROTTLE_NAMED(1.0, "deterministic_trac_ik", "kdl step took %f seconds", std::chrono::duration<double>(after - before).count());
-            if (rc == 0) {
-                ROS_DEBUG_NAMED("deterministic_trac_ik", "KDL found solution on iteration %d", i);
-
-                q_out = ik_solver_.qout();
-
-                if (solve_type_ == Speed) {
+    const bool cost_bounded = cost_budget_ > 0.0;
+    for (int i = 0; i < max_iters && (!cost_bounded || cost_ < cost_budget_) && !stopped; ++i) {
+        // interleave iterations of the enabled solvers
+        IterativeIkSolver& curr = *solvers_[solver].solver;
+
+        auto before = std::chrono::high_resolution_clock::now();
+        int rc = curr.step(step_size);
+        auto after = std::chrono::high_resolution_clock::now();
+        iterations_ += step_size;
+        charge_work(solver, step_size);
+        ROS_DEBUG_THROTTLE_NAMED(1.0, "deterministic_trac_ik", "%s step took %f seconds", curr.name(), std::chrono::duration<double>(after - before).count());
+
+        PortfolioEntry& entry = solvers_[solver];
+        if (entry.refining && curr.restartCounters().restarts() != entry.restarts) {
+            // the restart policy moved the solver off its candidate, so
+            // whatever it converges to is no longer a refinement
+            ROS_DEBUG_NAMED("deterministic_trac_ik", "%s restarted while refining; dropping candidate", curr.name());
+            entry.refining = false;
+            curr.setEps(std::max(entry.eps, candidate_eps_));
+        }
+
+        if (rc == 0) {
+            ROS_DEBUG_NAMED("deterministic_trac_ik", "%s found solution on iteration %d", curr.name(), i);
+
+            q_out = curr.qout();
+
+            if (solve_type_ == Speed) {
+                if (unique_solution(q_out) && accept_solution(q_out, filter)) {
                     return 0; // first solution returned
                 }
-
+            } else {
                 switch (solve_type_) {
                 case Manip1:
                 case Manip2:
@@ -336,90 +742,215 @@ int Deterministic_TRAC_IK::CartToJnt(
                     break;
                 }
 
-                if (unique_solution(q_out)) {
-                    solutions_.push_back(q_out);
-                    double err;
-                    switch (solve_type_) {
-                    case Manip1:
-                        err = manipPenalty(q_out) * Deterministic_TRAC_IK::ManipValue1(q_out);
-                        break;
-                    case Manip2:
-                        err = manipPenalty(q_out) * Deterministic_TRAC_IK::ManipValue2(q_out);
-                        break;
-                    default:
-                        err = JointErr(q_init, q_out);
-                        break;
+                if (coarse && !entry.refining) {
+                    if (unique_solution(q_out) && improves_solution(q_init, q_out)) {
+                        // continue from the candidate at the final tolerance;
+                        // its iterations count toward the budget as before
+                        ROS_DEBUG_NAMED("deterministic_trac_ik", "%s refining candidate", curr.name());
+                        entry.refining = true;
+                        entry.restarts = curr.restartCounters().restarts();
+                        curr.setEps(entry.eps);
+                        curr.restart(q_out);
+                    } else {
+                        rejected_.push_back(q_out);
+                    }
+                } else {
+                    // solutions found by other solvers while this one refined
+                    // may have overtaken its candidate
+                    bool improves = true;
+                    if (entry.refining) {
+                        entry.refining = false;
+                        curr.setEps(std::max(entry.eps, candidate_eps_));
+                        improves = improves_solution(q_init, q_out);
+                        if (!improves) {
+                            rejected_.push_back(q_out);
+                        }
                     }
 
-                    errors_.emplace_back(err, solutions_.size() - 1);
+                    if (improves && unique_solution(q_out) && accept_solution(q_out, filter)) {
+                        add_solution(q_init, q_out);
+                        stopped = stop_early && &curr == &ik_solver_;
+                    }
                 }
+            }
 
-                // sample a new random seed to search for additional solutions
-                // on successive iterations
+            // sample a new random seed to search for additional solutions
+            // on successive iterations
+            if (!entry.refining) {
                 randomize(seed_, q_init);
-                ik_solver_.restart(seed_);
+                curr.restart(seed_);
             }
+        }
 
-            solver = SOLVER_NLOPT;
-        }   break;
-        case SOLVER_NLOPT: {
-            auto before = std::chrono::high_resolution_clock::now();
-            int rc =  nl_solver_.step(step_size); // for some reason, 1 and 2 produce no solutions
-            auto after = std::chrono::high_resolution_clock::now();
-            ROS_DEBUG_THROTTLE_NAMED(1.0, "deterministic_trac_ik", "nlopt step took %f seconds", std::chrono::duration<double>(after - before).count());
-            if (rc == 0) {
-                ROS_DEBUG_NAMED("deterministic_trac_ik", "NLOPT found solution on iteration %d", i);
+        if (stagnation_.patience > 0 && solutions_.empty() && stagnated(solver)) {
+            ROS_DEBUG_NAMED("deterministic_trac_ik", "Residual stagnated above %f on iteration %d; giving up", stagnation_.threshold, i);
+            restore_eps();
+            return Stagnated;
+        }
 
-                q_out = nl_solver_.qout();
+        do {
+            solver = (solver + 1) % solvers_.size();
+        } while (!solvers_[solver].enabled);
+    }
 
-                if (solve_type_ == Speed) {
-                    return 0; // first solution returned
-                }
+    restore_eps();
+    return best_solution(q_out);
+}
 
-                switch (solve_type_) {
-                case Manip1:
-                case Manip2:
-                    normalize_limits(q_init, q_out);
-                    break;
-                default:
-                    normalize_seed(q_init, q_out);
-                    break;
-                }
+void Deterministic_TRAC_IK::seedQuery(
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits)
+{
+    uint64_t hash = HashBytes(&seed_salt_, sizeof(seed_salt_));
+    hash = HashQuery(q_init, p_in, bounds, hash);
+    hash = HashBytes(consistency_limits.data.data(), consistency_limits.data.size() * sizeof(double), hash);
 
-                if (unique_solution(q_out)) {
-                    solutions_.push_back(q_out);
-                    double err;
-                    switch (solve_type_) {
-                    case Manip1:
-                        err = manipPenalty(q_out) * Deterministic_TRAC_IK::ManipValue1(q_out);
-                        break;
-                    case Manip2:
-                        err = manipPenalty(q_out) * Deterministic_TRAC_IK::ManipValue2(q_out);
-                        break;
-                    default:
-                        err = JointErr(q_init, q_out);
-                        break;
-                    }
+    std::seed_seq seq{ uint32_t(hash), uint32_t(hash >> 32) };
+    rng_.seed(seq);
 
-                    errors_.emplace_back(err, solutions_.size() - 1);
-                }
+    // give each solver its own stream, independent of the others
+    for (uint64_t i = 0; i < solvers_.size(); ++i) {
+        solvers_[i].solver->setRandomSeed(HashBytes(&i, sizeof(i), hash));
+    }
+}
 
-                randomize(seed_, q_init);
-                nl_solver_.restart(seed_);
-            }
+bool Deterministic_TRAC_IK::stagnated(size_t i)
+{
+    const double residual = solvers_[i].solver->bestResidual();
+    if (residual < stagnation_best_[i] * (1.0 - stagnation_.min_improvement)) {
+        stagnation_best_[i] = residual;
+        stagnation_rounds_[i] = 0;
+    } else {
+        ++stagnation_rounds_[i];
+    }
+
+    for (size_t j = 0; j < solvers_.size(); ++j) {
+        if (!solvers_[j].enabled) {
+            continue;
+        }
+        if (stagnation_rounds_[j] < stagnation_.patience ||
+            solvers_[j].solver->bestResidual() <= stagnation_.threshold)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Deterministic_TRAC_IK::setCostModel(const CostModel& model)
+{
+    if (!model.valid()) {
+        return false;
+    }
+    cost_model_ = model;
+    return true;
+}
+
+void Deterministic_TRAC_IK::charge_work(size_t i, int iterations)
+{
+    const IterativeIkSolver& solver = *solvers_[i].solver;
+    WorkCounters spent;
+    if (solver.countsWork()) {
+        const WorkCounters work = solver.work();
+        spent = work - work_charged_[i];
+        work_charged_[i] = work;
+    } else {
+        spent.fk = iterations;
+    }
+    cost_ += cost_model_.cost(spent, chain_.getNrOfJoints());
+}
+
+int Deterministic_TRAC_IK::searchAnalytic(
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    KDL::JntArray& q_out,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits,
+    const SolutionFilter& filter)
+{
+    analytic_solutions_.clear();
+    if (!analytic_solver_->CartToJnt(p_in, analytic_solutions_)) {
+        return NoSolution;
+    }
+
+    for (auto& sol : analytic_solutions_) {
+        if (sol.data.size() != chain_.getNrOfJoints()) {
+            continue;
+        }
+
+        switch (solve_type_) {
+        case Manip1:
+        case Manip2:
+            normalize_limits(q_init, sol);
+            break;
+        default:
+            normalize_seed(q_init, sol);
+            break;
+        }
 
-            solver = SOLVER_KDL;
-        }   break;
-        default: {
-            ROS_ERROR_NAMED("deterministic_trac_ik", "Unknown solver type");
-            assert(0);
-        }   break;
+        if (!satisfies(sol, q_init, p_in, bounds, consistency_limits) ||
+            !unique_solution(sol) ||
+            !accept_solution(sol, filter))
+        {
+            continue;
         }
+
+        if (solve_type_ == Speed) {
+            q_out = sol;
+            return 0;
+        }
+
+        add_solution(q_init, sol);
     }
 
+    ROS_DEBUG_NAMED("deterministic_trac_ik", "Analytic solver found %zu valid solutions", solutions_.size());
+    return best_solution(q_out);
+}
+
+double Deterministic_TRAC_IK::score_solution(
+    const KDL::JntArray& q_init,
+    const KDL::JntArray& sol)
+{
+    switch (solve_type_) {
+    case Manip1:
+        return manipPenalty(sol) * Deterministic_TRAC_IK::ManipValue1(sol);
+    case Manip2:
+        return manipPenalty(sol) * Deterministic_TRAC_IK::ManipValue2(sol);
+    default:
+        return JointErr(q_init, sol);
+    }
+}
+
+bool Deterministic_TRAC_IK::improves_solution(
+    const KDL::JntArray& q_init,
+    const KDL::JntArray& sol)
+{
+    const double err = score_solution(q_init, sol);
+    const bool maximize = solve_type_ == Manip1 || solve_type_ == Manip2;
+    for (const auto& e : errors_) {
+        if (maximize ? e.first >= err : e.first <= err) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Deterministic_TRAC_IK::add_solution(
+    const KDL::JntArray& q_init,
+    const KDL::JntArray& sol)
+{
+    solutions_.push_back(sol);
+    errors_.emplace_back(score_solution(q_init, sol), solutions_.size() - 1);
+}
+
+int Deterministic_TRAC_IK::best_solution(KDL::JntArray& q_out)
+{
     if (solutions_.empty()) {
         ROS_DEBUG_NAMED("deterministic_trac_ik", "Failed to find solution");
-        return -3;
+        return NoSolution;
     }
 
     using solution_error = std::pair<double, unsigned int>;
@@ -0,0 +1,403 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/ik_cache.hpp>
+
+// standard includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+// system includes
+#include <ros/ros.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// project includes
+#include <deterministic_trac_ik/utils.h>
+
+namespace Deterministic_TRAC_IK {
+
+namespace {
+
+const char kSnapshotMagic[8] = { 'D', 'T', 'I', 'K', 'C', 'A', 'C', 'H' };
+const uint32_t kSnapshotVersion = 2;
+
+// Marks the end of the optional consistency limits in a key.
+const int64_t kKeySeparator = std::numeric_limits<int64_t>::min();
+
+// Solve type, position, orientation, bounds, and separator of a key, which
+// also holds the seed and optionally the consistency limits.
+const uint32_t kMinKeySize = 15;
+
+inline size_t MaxKeySize(unsigned int num_joints)
+{
+    return kMinKeySize + 2 * num_joints;
+}
+
+// Bytes of a snapshot entry with a key of key_size.
+inline uint64_t EntrySize(uint32_t key_size, unsigned int num_joints)
+{
+    return 3 * sizeof(uint32_t) + key_size * sizeof(int64_t) + num_joints * sizeof(double);
+}
+
+inline int64_t Quantize(double value, double resolution)
+{
+    // clamp so that unbounded tolerances (e.g. float max) do not overflow
+    const double max_steps = 1e15;
+    double steps = value / resolution;
+    if (steps > max_steps) {
+        steps = max_steps;
+    } else if (steps < -max_steps) {
+        steps = -max_steps;
+    }
+    return std::llround(steps);
+}
+
+template <typename T>
+void Write(std::ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool Read(std::istream& in, T& value)
+{
+    return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+} // namespace
+
+size_t IKCache::KeyHash::operator()(const Key& key) const
+{
+    return HashBytes(key.data(), key.size() * sizeof(int64_t));
+}
+
+IKCache::IKCache(
+    size_t capacity,
+    double position_resolution,
+    double angle_resolution)
+:
+    capacity_(capacity),
+    position_resolution_(position_resolution),
+    angle_resolution_(angle_resolution),
+    entries_(),
+    index_(),
+    hits_(0),
+    misses_(0)
+{
+    assert(position_resolution_ > 0.0);
+    assert(angle_resolution_ > 0.0);
+}
+
+size_t IKCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+IKCache::Key IKCache::makeKey(
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    const KDL::Twist& bounds,
+    const KDL::JntArray& consistency_limits,
+    int solve_type) const
+{
+    Key key;
+    key.reserve(14 + q_init.data.size() + consistency_limits.data.size());
+
+    key.push_back(solve_type);
+
+    for (int i = 0; i < 3; ++i) {
+        key.push_back(Quantize(p_in.p(i), position_resolution_));
+    }
+
+    // q and -q represent the same rotation; pick the one with w >= 0
+    double x, y, z, w;
+    p_in.M.GetQuaternion(x, y, z, w);
+    const double sign = w < 0.0 ? -1.0 : 1.0;
+    key.push_back(Quantize(sign * x, angle_resolution_));
+    key.push_back(Quantize(sign * y, angle_resolution_));
+    key.push_back(Quantize(sign * z, angle_resolution_));
+    key.push_back(Quantize(sign * w, angle_resolution_));
+
+    for (int i = 0; i < 3; ++i) {
+        key.push_back(Quantize(std::abs(bounds.vel(i)), position_resolution_));
+    }
+    for (int i = 0; i < 3; ++i) {
+        key.push_back(Quantize(std::abs(bounds.rot(i)), angle_resolution_));
+    }
+
+    for (unsigned int i = 0; i < q_init.data.size(); ++i) {
+        key.push_back(Quantize(q_init(i), angle_resolution_));
+    }
+
+    key.push_back(kKeySeparator);
+    for (unsigned int i = 0; i < consistency_limits.data.size(); ++i) {
+        key.push_back(Quantize(std::abs(consistency_limits(i)), angle_resolution_));
+    }
+
+    return key;
+}
+
+bool IKCache::lookup(
+    const Key& key,
+    KDL::JntArray& q_out,
+    int& rc,
+    const std::function<bool(const KDL::JntArray&)>& accept)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = index_.find(key);
+    if (it == index_.end() || !accept(it->second->q)) {
+        ++misses_;
+        return false;
+    }
+
+    // move to the front of the recently-used list
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+    q_out = it->second->q;
+    rc = it->second->rc;
+    ++hits_;
+    return true;
+}
+
+void IKCache::insert(const Key& key, const KDL::JntArray& q_out, int rc)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    insertLocked(key, q_out, rc);
+}
+
+void IKCache::insertLocked(const Key& key, const KDL::JntArray& q_out, int rc)
+{
+    if (capacity_ == 0) {
+        return;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        it->second->q = q_out;
+        it->second->rc = rc;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+
+    if (entries_.size() >= capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+
+    entries_.push_front(Entry{ key, q_out, rc });
+    index_[key] = entries_.begin();
+}
+
+void IKCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+}
+
+uint64_t IKCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t IKCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+void IKCache::resetCounters()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    hits_ = 0;
+    misses_ = 0;
+}
+
+bool IKCache::save(
+    const std::string& path,
+    uint64_t chain_signature,
+    unsigned int num_joints) const
+{
+    // the lock serializes the caches saving to path; loads need not take it
+    // since the snapshot is replaced by renaming
+    const int fd = OpenLocked(path);
+    if (fd < 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to lock IK cache snapshot %s", path.c_str());
+        return false;
+    }
+
+    IKCache merged(capacity_, position_resolution_, angle_resolution_);
+    merged.readLocked(path, chain_signature, num_joints);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+            if (it->q.data.size() == num_joints &&
+                it->key.size() <= MaxKeySize(num_joints))
+            {
+                merged.insertLocked(it->key, it->q, it->rc);
+            }
+        }
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+
+    out.write(kSnapshotMagic, sizeof(kSnapshotMagic));
+    Write(out, kSnapshotVersion);
+    Write(out, chain_signature);
+    Write(out, (uint32_t)num_joints);
+    Write(out, position_resolution_);
+    Write(out, angle_resolution_);
+    Write(out, (uint64_t)merged.entries_.size());
+
+    for (auto it = merged.entries_.rbegin(); it != merged.entries_.rend(); ++it) {
+        Write(out, (uint32_t)it->key.size());
+        out.write(reinterpret_cast<const char*>(it->key.data()), it->key.size() * sizeof(int64_t));
+        Write(out, (int32_t)it->rc);
+        Write(out, (uint32_t)it->q.data.size());
+        out.write(reinterpret_cast<const char*>(it->q.data.data()), it->q.data.size() * sizeof(double));
+    }
+    out.close();
+
+    bool success = true;
+    if (!out || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to write IK cache snapshot %s", path.c_str());
+        unlink(tmp_path.c_str());
+        success = false;
+    }
+
+    flock(fd, LOCK_UN);
+    ::close(fd);
+    return success;
+}
+
+bool IKCache::load(
+    const std::string& path,
+    uint64_t chain_signature,
+    unsigned int num_joints)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return readLocked(path, chain_signature, num_joints);
+}
+
+bool IKCache::readLocked(
+    const std::string& path,
+    uint64_t chain_signature,
+    unsigned int num_joints)
+{
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    const std::streamoff size = in ? (std::streamoff)in.tellg() : 0;
+    if (size <= 0) {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "No IK cache snapshot at %s", path.c_str());
+        return false;
+    }
+    in.seekg(0);
+
+    char magic[sizeof(kSnapshotMagic)];
+    uint32_t version;
+    uint64_t signature;
+    uint32_t joints;
+    double position_resolution, angle_resolution;
+    uint64_t count;
+    if (!in.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), kSnapshotMagic) ||
+        !Read(in, version) || version != kSnapshotVersion ||
+        !Read(in, signature) || !Read(in, joints) ||
+        !Read(in, position_resolution) || !Read(in, angle_resolution) ||
+        !Read(in, count))
+    {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "IK cache snapshot %s is invalid", path.c_str());
+        return false;
+    }
+
+    if (signature != chain_signature || joints != num_joints) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "IK cache snapshot %s was taken for a different chain", path.c_str());
+        return false;
+    }
+
+    if (position_resolution != position_resolution_ ||
+        angle_resolution != angle_resolution_)
+    {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "IK cache snapshot %s was taken with different resolutions", path.c_str());
+        return false;
+    }
+
+    // bound the sizes read from the snapshot by its size and the joint count
+    // so that a corrupt snapshot cannot cause huge allocations
+    const uint64_t remaining = size - (std::streamoff)in.tellg();
+    if (count > remaining / EntrySize(kMinKeySize, num_joints)) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "IK cache snapshot %s is invalid", path.c_str());
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t key_size, q_size;
+        int32_t rc;
+        if (!Read(in, key_size)) {
+            break;
+        }
+        if (key_size < kMinKeySize || key_size > MaxKeySize(num_joints)) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "IK cache snapshot %s is invalid", path.c_str());
+            return false;
+        }
+        Key key(key_size);
+        if (!in.read(reinterpret_cast<char*>(key.data()), key_size * sizeof(int64_t)) ||
+            !Read(in, rc) || !Read(in, q_size))
+        {
+            break;
+        }
+        if (q_size != num_joints) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "IK cache snapshot %s is invalid", path.c_str());
+            return false;
+        }
+        KDL::JntArray q(q_size);
+        if (!in.read(reinterpret_cast<char*>(q.data.data()), q_size * sizeof(double))) {
+            break;
+        }
+        insertLocked(key, q, rc);
+    }
+
+    if (!in) {
+        ROS_WARN_NAMED("deterministic_trac_ik", "IK cache snapshot %s is truncated", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -31,6 +31,8 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <deterministic_trac_ik/kdl_tl.hpp>
 
 // standard includes
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 // system includes
@@ -41,6 +43,42 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace KDL {
 
+BasicJointType ClassifyJoint(const Joint& joint, double q_min, double q_max)
+{
+    switch (joint.getType()) {
+    case Joint::TransAxis:
+    case Joint::TransX:
+    case Joint::TransY:
+    case Joint::TransZ:
+        return BasicJointType::TransJoint;
+    default:
+        break;
+    }
+
+    if (q_max >= std::numeric_limits<float>::max() &&
+        q_min <= std::numeric_limits<float>::lowest())
+    {
+        return BasicJointType::Continuous;
+    }
+    return BasicJointType::RotJoint;
+}
+
+std::vector<BasicJointType> ClassifyJoints(
+    const Chain& chain,
+    const JntArray& q_min,
+    const JntArray& q_max)
+{
+    std::vector<BasicJointType> types;
+    for (const Segment& segment : chain.segments) {
+        if (segment.getJoint().getType() == Joint::None) {
+            continue;
+        }
+        const unsigned int j = types.size();
+        types.push_back(ClassifyJoint(segment.getJoint(), q_min(j), q_max(j)));
+    }
+    return types;
+}
+
 ChainIkSolverPos_TL::ChainIkSolverPos_TL(
     const Chain& chain,
     const JntArray& joint_min,
@@ -50,41 +88,122 @@ ChainIkSolverPos_TL::ChainIkSolverPos_TL(
     bool try_jl_wrap)
 :
     chain_(chain),
+    chain_min_(joint_min),
+    chain_max_(joint_max),
+    chain_types_(),
     joint_min_(joint_min),
     joint_max_(joint_max),
     joint_types_(),
-    vik_solver_(chain),
-    fk_solver_(chain),
+    fk_jac_solver_(chain_),
+    vel_solver_(MakeVelSolver(VelSolverPinv, chain.getNrOfJoints())),
+    vel_solver_type_(VelSolverPinv),
+    task_jac_(6, chain.getNrOfJoints()),
+    task_err_(6),
+    coarse_eps_(0.0),
+    coarse_(false),
+    coarse_fk_jac_(chain_),
+    coarse_jac_(6, chain.getNrOfJoints()),
+    coarse_vel_solver_(MakeVelSolverT<float>(VelSolverPinv, chain.getNrOfJoints())),
+    coarse_task_jac_(6, chain.getNrOfJoints()),
+    coarse_task_err_(6),
+    coarse_delta_q_(chain.getNrOfJoints()),
     bounds_(KDL::Twist::Zero()),
+    free_axes_(0),
+    task_rows_({ 0, 1, 2, 3, 4, 5 }),
     eps_(eps),
+    max_backtracks_(0),
+    active_set_(false),
     rr_(random_restart),
     wrap_(try_jl_wrap),
     q_buff1_(chain_.getNrOfJoints()),
     q_buff2_(chain_.getNrOfJoints()),
     q_curr_(&q_buff1_),
     q_next_(&q_buff2_),
+    jac_curr_(chain.getNrOfJoints()),
     delta_q_(chain.getNrOfJoints()),
-    done_(true)
+    ns_objective_(NullSpaceNone),
+    ns_gain_(0.5),
+    q_ref_(chain.getNrOfJoints()),
+    ns_svd_(6, chain.getNrOfJoints(), Eigen::ComputeThinV),
+    ns_grad_(chain.getNrOfJoints()),
+    ns_proj_(chain.getNrOfJoints()),
+    ns_step_(0.0),
+    ns_settle_(0),
+    ns_q_(chain.getNrOfJoints()),
+    ns_f_(),
+    ns_jac_(chain.getNrOfJoints()),
+    done_(true),
+    best_residual_(std::numeric_limits<double>::infinity()),
+    residual_(std::numeric_limits<double>::infinity()),
+    saturated_(chain.getNrOfJoints(), 0),
+    work_(),
+    trace_(),
+    trace_step_(0),
+    trace_restarted_(false)
 {
     assert(chain_.getNrOfJoints() == joint_min.data.size());
     assert(chain_.getNrOfJoints() == joint_max.data.size());
 
-    for (size_t i = 0; i < chain_.segments.size(); i++) {
-        std::string type = chain_.segments[i].getJoint().getTypeName();
-        if (type.find("Rot") != std::string::npos) {
-            if (joint_max(joint_types_.size()) >= std::numeric_limits<float>::max() &&
-                joint_min(joint_types_.size()) <= std::numeric_limits<float>::lowest())
-            {
-                joint_types_.push_back(KDL::BasicJointType::Continuous);
-            } else {
-                joint_types_.push_back(KDL::BasicJointType::RotJoint);
-            }
-        } else if (type.find("Trans") != std::string::npos) {
-            joint_types_.push_back(KDL::BasicJointType::TransJoint);
+    joint_types_ = ClassifyJoints(chain_, joint_min, joint_max);
+
+    chain_types_ = joint_types_;
+}
+
+void ChainIkSolverPos_TL::setJointLimits(
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max)
+{
+    assert(q_min.data.size() == chain_min_.data.size());
+    assert(q_max.data.size() == chain_max_.data.size());
+
+    for (size_t j = 0; j < chain_types_.size(); ++j) {
+        joint_min_(j) = std::max(chain_min_(j), q_min(j));
+        joint_max_(j) = std::min(chain_max_(j), q_max(j));
+        if (chain_types_[j] == KDL::BasicJointType::Continuous &&
+            joint_min_(j) > std::numeric_limits<float>::lowest() &&
+            joint_max_(j) < std::numeric_limits<float>::max())
+        {
+            joint_types_[j] = KDL::BasicJointType::RotJoint;
+        } else {
+            joint_types_[j] = chain_types_[j];
+        }
+    }
+}
+
+void ChainIkSolverPos_TL::setRandomSeed(uint64_t seed)
+{
+    std::seed_seq seq{ uint32_t(seed), uint32_t(seed >> 32) };
+    rng_.seed(seq);
+}
+
+void ChainIkSolverPos_TL::setBounds(const KDL::Twist& bounds)
+{
+    bounds_ = bounds;
+    free_axes_ = FreeAxes(bounds);
+
+    task_rows_.clear();
+    for (int i = 0; i < 6; ++i) {
+        if (!(free_axes_ & (1u << i))) {
+            task_rows_.push_back(i);
         }
     }
 
-    assert(joint_types_.size() == joint_max.data.size());
+    task_jac_.resize(task_rows_.size(), chain_.getNrOfJoints());
+    task_err_.resize(task_rows_.size());
+    coarse_task_jac_.resize(task_rows_.size(), chain_.getNrOfJoints());
+    coarse_task_err_.resize(task_rows_.size());
+}
+
+void ChainIkSolverPos_TL::setCoarseEps(double coarse_eps)
+{
+    coarse_eps_ = coarse_eps;
+}
+
+void ChainIkSolverPos_TL::resetJointLimits()
+{
+    joint_min_ = chain_min_;
+    joint_max_ = chain_max_;
+    joint_types_ = chain_types_;
 }
 
 int ChainIkSolverPos_TL::CartToJnt(
@@ -93,7 +212,7 @@ int ChainIkSolverPos_TL::CartToJnt(
     KDL::JntArray& q_out,
     const KDL::Twist& bounds)
 {
-    bounds_ = bounds;
+    setBounds(bounds);
     restart(q_init, p_in);
 
     const int max_iterations = 100;
@@ -119,16 +238,277 @@ void ChainIkSolverPos_TL::restart(
     const KDL::Frame& p_in)
 {
     *q_curr_ = q_init;
-    fk_solver_.JntToCart(*q_curr_, f_curr_);
+    q_ref_ = q_init;
+    coarse_ = coarse_eps_ > 0.0;
+    updateKinematics();
     f_target_ = p_in;
+    ns_settle_ = 0;
     done_ = false;
+    best_residual_ = std::numeric_limits<double>::infinity();
+    residual_ = std::numeric_limits<double>::infinity();
+    std::fill(saturated_.begin(), saturated_.end(), 0);
+    restart_.reset();
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    trace_step_ = 0;
+    trace_restarted_ = false;
+#endif
 }
 
 void ChainIkSolverPos_TL::restart(const KDL::JntArray& q_init)
 {
     *q_curr_ = q_init;
-    fk_solver_.JntToCart(*q_curr_, f_curr_);
+    coarse_ = coarse_eps_ > 0.0;
+    updateKinematics();
+    ns_settle_ = 0;
     done_ = false;
+    residual_ = std::numeric_limits<double>::infinity();
+    std::fill(saturated_.begin(), saturated_.end(), 0);
+    restart_.reset();
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    trace_restarted_ = true;
+#endif
+}
+
+void ChainIkSolverPos_TL::updateKinematics()
+{
+    if (coarse_) {
+        coarse_fk_jac_.JntToCartJac(*q_curr_, f_curr_, coarse_jac_);
+    } else {
+        fk_jac_solver_.JntToCartJac(*q_curr_, f_curr_, jac_curr_);
+    }
+    ++work_.fk;
+    ++work_.jacobian;
+}
+
+KDL::Twist ChainIkSolverPos_TL::boundedResidual() const
+{
+    KDL::Twist delta_twist = diffRelativeFree(f_target_, f_curr_, free_axes_);
+    for (int i = 0; i < 6; ++i) {
+        if (std::abs(delta_twist[i]) <= std::abs(bounds_[i])) {
+            delta_twist[i] = 0.0;
+        }
+    }
+    return delta_twist;
+}
+
+// Fill task_jac and task_err with the rows of jac and delta_twist that are
+// constrained by free_axes, expressed in the frame of the target rotation
+// r_target. Return false if no row is constrained.
+template <typename Scalar>
+static bool ProjectTask(
+    const Eigen::Matrix<Scalar, 6, Eigen::Dynamic>& jac,
+    const KDL::Twist& delta_twist,
+    const KDL::Rotation& r_target,
+    unsigned int free_axes,
+    const std::vector<int>& task_rows,
+    TaskJacobianT<Scalar>& task_jac,
+    TaskVectorT<Scalar>& task_err)
+{
+    if (free_axes == 0) {
+        task_jac = jac;
+        for (int i = 0; i < 6; ++i) {
+            task_err(i) = Scalar(delta_twist[i]);
+        }
+        return true;
+    }
+
+    if (task_rows.empty()) {
+        return false;
+    }
+
+    // the bounds are expressed in the target frame, so rotate the residual
+    // and Jacobian into it and keep only the constrained rows
+    typedef Eigen::Matrix<double, 3, 3, Eigen::RowMajor> Matrix3r;
+    const Eigen::Matrix<Scalar, 3, 3> r = Eigen::Map<const Matrix3r>(r_target.data).cast<Scalar>();
+    const KDL::Vector dv = r_target.Inverse(delta_twist.vel);
+    const KDL::Vector dr = r_target.Inverse(delta_twist.rot);
+    for (size_t k = 0; k < task_rows.size(); ++k) {
+        const int i = task_rows[k];
+        if (i < 3) {
+            task_jac.row(k).noalias() = r.col(i).transpose() * jac.template topRows<3>();
+            task_err(k) = Scalar(dv[i]);
+        } else {
+            task_jac.row(k).noalias() = r.col(i - 3).transpose() * jac.template bottomRows<3>();
+            task_err(k) = Scalar(dr[i - 3]);
+        }
+    }
+    return true;
+}
+
+// Solve for the joint step, then drop the joints resting on a limit that
+// the step would push further into it and solve again without them; the
+// other saturated joints are released. Return the number of solves.
+template <typename Scalar>
+static int SolveActiveSet(
+    VelSolverT<Scalar>& vel_solver,
+    std::vector<int>& saturated,
+    TaskJacobianT<Scalar>& task_jac,
+    const TaskVectorT<Scalar>& task_err,
+    typename VelSolverT<Scalar>::JointVector& qdot)
+{
+    vel_solver.solve(task_jac, task_err, qdot);
+
+    bool dropped = false;
+    for (size_t j = 0; j < saturated.size(); ++j) {
+        if (saturated[j] == 0) {
+            continue;
+        }
+        if (saturated[j] * qdot(j) > Scalar(0)) {
+            task_jac.col(j).setZero();
+            dropped = true;
+        } else {
+            saturated[j] = 0;
+        }
+    }
+
+    if (dropped) {
+        vel_solver.solve(task_jac, task_err, qdot);
+        return 2;
+    }
+    return 1;
+}
+
+void ChainIkSolverPos_TL::solveVelocity(
+    const KDL::Twist& delta_twist,
+    KDL::JntArray& delta_q)
+{
+    int solves = 1;
+    if (coarse_) {
+        if (!ProjectTask(coarse_jac_, delta_twist, f_target_.M, free_axes_, task_rows_, coarse_task_jac_, coarse_task_err_)) {
+            delta_q.data.setZero();
+            return;
+        }
+        if (active_set_) {
+            solves = SolveActiveSet(*coarse_vel_solver_, saturated_, coarse_task_jac_, coarse_task_err_, coarse_delta_q_);
+        } else {
+            coarse_vel_solver_->solve(coarse_task_jac_, coarse_task_err_, coarse_delta_q_);
+        }
+        delta_q.data = coarse_delta_q_.cast<double>();
+    } else {
+        if (!ProjectTask(jac_curr_.data, delta_twist, f_target_.M, free_axes_, task_rows_, task_jac_, task_err_)) {
+            delta_q.data.setZero();
+            return;
+        }
+        if (active_set_) {
+            solves = SolveActiveSet(*vel_solver_, saturated_, task_jac_, task_err_, delta_q.data);
+        } else {
+            vel_solver_->solve(task_jac_, task_err_, delta_q.data);
+        }
+    }
+
+    if (vel_solver_type_ == VelSolverPinv) {
+        work_.svd += solves;
+    }
+}
+
+void ChainIkSolverPos_TL::setVelSolver(VelSolverType type)
+{
+    if (type == vel_solver_type_) {
+        return;
+    }
+    vel_solver_ = MakeVelSolver(type, chain_.getNrOfJoints());
+    coarse_vel_solver_ = MakeVelSolverT<float>(type, chain_.getNrOfJoints());
+    vel_solver_type_ = type;
+}
+
+void ChainIkSolverPos_TL::setDamping(const AdaptiveDamping& damping)
+{
+    vel_solver_->setDamping(damping);
+    coarse_vel_solver_->setDamping(damping);
+}
+
+void ChainIkSolverPos_TL::setNullSpaceObjective(
+    NullSpaceObjective objective,
+    double gain)
+{
+    ns_objective_ = objective;
+    ns_gain_ = gain;
+}
+
+double ChainIkSolverPos_TL::logManipulability(const KDL::Jacobian& jac)
+{
+    const Eigen::Matrix<double, 6, 6> jjt = jac.data * jac.data.transpose();
+    const double det = jjt.determinant();
+    if (det <= 0.0) {
+        return -std::numeric_limits<double>::infinity();
+    }
+    return 0.5 * std::log(det);
+}
+
+void ChainIkSolverPos_TL::objectiveGradient()
+{
+    switch (ns_objective_) {
+    case NullSpaceJointDistance:
+        ns_grad_ = q_curr_->data - q_ref_.data;
+        break;
+    case NullSpaceJointLimits:
+        // distance from the middle of the range, normalized by its half-width
+        for (unsigned int j = 0; j < joint_types_.size(); ++j) {
+            if (joint_types_[j] == KDL::BasicJointType::Continuous) {
+                ns_grad_(j) = 0.0;
+                continue;
+            }
+            const double mid = 0.5 * (joint_max_(j) + joint_min_(j));
+            const double half_range = 0.5 * (joint_max_(j) - joint_min_(j));
+            ns_grad_(j) = half_range > 0.0 ? ((*q_curr_)(j) - mid) / half_range : 0.0;
+        }
+        break;
+    case NullSpaceManipulability: {
+        // forward differences of -log(manipulability); the Jacobian at
+        // q_curr_ is already known
+        const double h = 1e-6;
+        const double w = logManipulability(jac_curr_);
+        if (!std::isfinite(w)) {
+            ns_grad_.setZero();
+            break;
+        }
+        ns_q_ = *q_curr_;
+        for (unsigned int j = 0; j < ns_q_.rows(); ++j) {
+            ns_q_(j) += h;
+            fk_jac_solver_.JntToCartJac(ns_q_, ns_f_, ns_jac_);
+            ++work_.fk;
+            ++work_.jacobian;
+            const double wj = logManipulability(ns_jac_);
+            ns_grad_(j) = std::isfinite(wj) ? -(wj - w) / h : 0.0;
+            ns_q_(j) = (*q_curr_)(j);
+        }
+    }   break;
+    default:
+        ns_grad_.setZero();
+        break;
+    }
+}
+
+void ChainIkSolverPos_TL::addNullSpaceStep(KDL::JntArray& delta_q)
+{
+    objectiveGradient();
+
+    // remove the component of the gradient that would move the tip. The
+    // projector is built from the SVD of the Jacobian rather than the
+    // velocity solver so that damping near singularities does not leak the
+    // secondary step into the task space.
+    const double eps = 1e-5;
+    ns_svd_.compute(task_jac_);
+    ++work_.svd;
+    const auto& sigma = ns_svd_.singularValues();
+    ns_proj_ = ns_grad_;
+    for (int i = 0; i < sigma.size(); ++i) {
+        if (sigma(i) < eps) {
+            break;
+        }
+        const auto v = ns_svd_.matrixV().col(i);
+        ns_proj_ -= v.dot(ns_grad_) * v;
+    }
+
+    // limit the secondary step so that steep objectives, e.g. manipulability
+    // near a singularity, cannot dominate the primary task
+    const double max_step = 0.1;
+    ns_proj_ *= -ns_gain_;
+    ns_step_ = ns_proj_.norm();
+    if (ns_step_ > max_step) {
+        ns_proj_ *= max_step / ns_step_;
+    }
+    delta_q.data += ns_proj_;
 }
 
 int ChainIkSolverPos_TL::step(int steps)
@@ -138,19 +518,33 @@ int ChainIkSolverPos_TL::step(int steps)
     }
 
     for (int i = 0; i < steps; ++i) {
-        KDL::Twist delta_twist = diff(f_curr_, f_target_);
+        KDL::Twist delta_twist;
+        if (free_axes_ == 0) {
+            delta_twist = diff(f_curr_, f_target_);
+        } else {
+            // same residual, skipping the computation of free parts
+            delta_twist = diffRelativeFree(f_target_, f_curr_, free_axes_);
+            delta_twist = f_target_.M * -delta_twist;
+        }
 
-        vik_solver_.CartToJnt(*q_curr_, delta_twist, delta_q_);
+        solveVelocity(delta_twist, delta_q_);
+
+        if (ns_objective_ != NullSpaceNone && !coarse_) {
+            addNullSpaceStep(delta_q_);
+        }
 
         // apply delta to get the next configuration
         Add(*q_curr_, delta_q_, *q_next_);
 
+        bool clamped = false;
+
         // handle minimum variable bound
         for (size_t j = 0; j < joint_min_.data.size(); ++j) {
             if (joint_types_[j] == KDL::BasicJointType::Continuous) {
                 continue;
             }
             if ((*q_next_)(j) < joint_min_(j)) {
+                clamped = true;
                 if (!wrap_ || joint_types_[j] == KDL::BasicJointType::TransJoint) {
                     // KDL's default
                     (*q_next_)(j) = joint_min_(j);
@@ -176,6 +570,7 @@ int ChainIkSolverPos_TL::step(int steps)
             }
 
             if ((*q_next_)(j) > joint_max_(j)) {
+                clamped = true;
                 if (!wrap_ || joint_types_[j] == KDL::BasicJointType::TransJoint) {
                     // KDL's default
                     (*q_next_)(j) = joint_max_(j);
@@ -196,11 +591,19 @@ int ChainIkSolverPos_TL::step(int steps)
         // store the actually-moved delta in q_curr_
         Subtract(*q_curr_, *q_next_, *q_curr_);
 
-        if (q_curr_->data.isZero(boost::math::tools::epsilon<float>())) {
+        // single-precision steps bottom out at the noise of their Jacobian
+        // and residual, well above the threshold below, so stalls are told
+        // apart in double precision instead
+        const double coarse_stall = 1e-5;
+        if (coarse_ && q_curr_->data.isZero(coarse_stall)) {
+            coarse_ = false;
+        }
+        else if (q_curr_->data.isZero(boost::math::tools::epsilon<float>())) {
             if (rr_) {
                 std::swap(q_curr_, q_next_);
-                randomize(*q_curr_);
-                fk_solver_.JntToCart(*q_curr_, f_curr_);
+                trace(residual_, clamped);
+                restart_.stalled();
+                randomRestart();
                 return 1;
             }
 
@@ -217,44 +620,132 @@ int ChainIkSolverPos_TL::step(int steps)
         // update the current configuration
         std::swap(q_curr_, q_next_);
 
-        // update tip frame
-        fk_solver_.JntToCart(*q_curr_, f_curr_);
-
-        delta_twist = diffRelative(f_target_, f_curr_);
-
-        if (std::abs(delta_twist.vel.x()) <= std::abs(bounds_.vel.x())) {
-            delta_twist.vel.x(0);
+        // update tip frame and the Jacobian for the next iteration
+        updateKinematics();
+
+        delta_twist = boundedResidual();
+        double residual = std::sqrt(
+                dot(delta_twist.vel, delta_twist.vel) +
+                dot(delta_twist.rot, delta_twist.rot));
+
+        // backtrack toward the previous configuration while the step
+        // increased the residual; q_next_ holds the negated step taken, and
+        // both of its ends are within the joint limits
+        for (int k = 0;
+             k < max_backtracks_ && residual > residual_ &&
+             !Equal(delta_twist, Twist::Zero(), eps_);
+             ++k)
+        {
+            q_next_->data *= 0.5;
+            q_curr_->data += q_next_->data;
+            updateKinematics();
+            delta_twist = boundedResidual();
+            residual = std::sqrt(
+                    dot(delta_twist.vel, delta_twist.vel) +
+                    dot(delta_twist.rot, delta_twist.rot));
         }
 
-        if (std::abs(delta_twist.vel.y()) <= std::abs(bounds_.vel.y())) {
-            delta_twist.vel.y(0);
-        }
+        trace(residual, clamped);
 
-        if (std::abs(delta_twist.vel.z()) <= std::abs(bounds_.vel.z())) {
-            delta_twist.vel.z(0);
+        // no fraction of the step reduced the residual: a local minimum
+        if (max_backtracks_ > 0 && residual > residual_ && rr_) {
+            restart_.stalled();
+            randomRestart();
+            return 1;
         }
+        residual_ = residual;
 
-        if (std::abs(delta_twist.rot.x()) <= std::abs(bounds_.rot.x())) {
-            delta_twist.rot.x(0);
+        if (active_set_) {
+            updateSaturated();
         }
 
-        if (std::abs(delta_twist.rot.y()) <= std::abs(bounds_.rot.y())) {
-            delta_twist.rot.y(0);
-        }
+        if (coarse_) {
+            if (residual > coarse_eps_) {
+                best_residual_ = std::min(best_residual_, residual);
+                if (restart_.update(*q_curr_, residual) && rr_) {
+                    randomRestart();
+                    return 1;
+                }
+                continue;
+            }
 
-        if (std::abs(delta_twist.rot.z()) <= std::abs(bounds_.rot.z())) {
-            delta_twist.rot.z(0);
+            // close enough to refine in double precision
+            coarse_ = false;
+            updateKinematics();
+            delta_twist = boundedResidual();
+            residual = std::sqrt(
+                    dot(delta_twist.vel, delta_twist.vel) +
+                    dot(delta_twist.rot, delta_twist.rot));
+            residual_ = residual;
         }
 
+        best_residual_ = std::min(best_residual_, residual);
+
         if (Equal(delta_twist, Twist::Zero(), eps_)) {
-            done_ = true;
-            return 0;
+            // keep descending the secondary objective, without leaving the
+            // target, until its step vanishes or the settling budget runs out
+            const double ns_tol = 1e-4;
+            const int ns_max_settle = 50;
+            if (ns_objective_ == NullSpaceNone ||
+                ns_step_ <= ns_tol ||
+                ++ns_settle_ >= ns_max_settle)
+            {
+                done_ = true;
+                return 0;
+            }
+        } else if (restart_.update(*q_curr_, residual) && rr_) {
+            randomRestart();
+            return 1;
         }
     }
 
     return 1;
 }
 
+void ChainIkSolverPos_TL::randomRestart()
+{
+    if (restart_.next(*q_curr_, rng_)) {
+        for (size_t j = 0; j < joint_types_.size(); ++j) {
+            if (joint_types_[j] != KDL::BasicJointType::Continuous) {
+                (*q_curr_)(j) = std::max(joint_min_(j), std::min(joint_max_(j), (*q_curr_)(j)));
+            }
+        }
+    } else {
+        randomize(*q_curr_);
+    }
+    coarse_ = coarse_eps_ > 0.0;
+    updateKinematics();
+    residual_ = std::numeric_limits<double>::infinity();
+    std::fill(saturated_.begin(), saturated_.end(), 0);
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    trace_restarted_ = true;
+#endif
+}
+
+void ChainIkSolverPos_TL::trace(double residual, bool clamped)
+{
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    DETERMINISTIC_TRAC_IK_TRACE_STEP(trace_, name(), trace_step_, residual, trace_restarted_, clamped);
+    ++trace_step_;
+    trace_restarted_ = false;
+#endif
+}
+
+void ChainIkSolverPos_TL::updateSaturated()
+{
+    for (size_t j = 0; j < saturated_.size(); ++j) {
+        if (joint_types_[j] == KDL::BasicJointType::Continuous) {
+            saturated_[j] = 0;
+        } else if ((*q_curr_)(j) <= joint_min_(j)) {
+            saturated_[j] = -1;
+        } else if ((*q_curr_)(j) >= joint_max_(j)) {
+            saturated_[j] = 1;
+        } else {
+            saturated_[j] = 0;
+        }
+    }
+}
+
 void ChainIkSolverPos_TL::randomize(KDL::JntArray& q)
 {
     for (size_t j = 0; j < q.data.size(); ++j) {
@@ -31,8 +31,10 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <deterministic_trac_ik/nlopt_ik.hpp>
 
 // standard includes
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <stdexcept>
 
 // standard includes
 #include <boost/date_time.hpp>
@@ -237,11 +239,16 @@ NLOPT_IK::NLOPT_IK(
     OptType _type)
 :
     chain_(chain),
+    chain_min_(),
+    chain_max_(),
+    chain_types_(),
     joint_min_(),
     joint_max_(),
     types_(),
     valid_(true),
     fk_solver_(chain),
+    bounds_(KDL::Twist::Zero()),
+    free_axes_(0),
     eps_(std::abs(eps)),
     best_x_(chain.getNrOfJoints()),
     x_min_(chain.getNrOfJoints()),
@@ -249,7 +256,15 @@ NLOPT_IK::NLOPT_IK(
     opt_type_(_type),
     q_out_(chain.getNrOfJoints()),
     tmp_(chain.getNrOfJoints()),
-    q_tmp_(chain.getNrOfJoints())
+    q_tmp_(chain.getNrOfJoints()),
+    best_residual_(std::numeric_limits<double>::infinity()),
+    step_residual_(std::numeric_limits<double>::infinity()),
+    work_(),
+    trace_(),
+    trace_step_(0),
+    trace_restarted_(false),
+    algorithm_(nlopt::LD_SLSQP),
+    xtol_(boost::math::tools::epsilon<float>())
 {
     /////////////////////////////////////
     // Initialize KDL Chain Properties //
@@ -269,34 +284,60 @@ NLOPT_IK::NLOPT_IK(
         joint_max_.push_back(q_max(i));
     }
 
-    for (uint i = 0; i < chain_.segments.size(); i++) {
-        std::string type = chain_.segments[i].getJoint().getTypeName();
-        if (type.find("Rot") != std::string::npos) {
-            if (q_max(types_.size()) >= std::numeric_limits<float>::max() && q_min(types_.size()) <= std::numeric_limits<float>::lowest()) {
-                types_.push_back(KDL::BasicJointType::Continuous);
-            } else {
-                types_.push_back(KDL::BasicJointType::RotJoint);
-            }
-        } else if (type.find("Trans") != std::string::npos) {
-            types_.push_back(KDL::BasicJointType::TransJoint);
-        }
-    }
+    types_ = KDL::ClassifyJoints(chain_, q_min, q_max);
 
     assert(types_.size() == joint_min_.size());
 
-    ///////////////////////
-    // Initialize solver //
-    ///////////////////////
+    chain_min_ = joint_min_;
+    chain_max_ = joint_max_;
+    chain_types_ = types_;
 
-    nlopt_ = nlopt::opt(nlopt::LD_SLSQP, chain_.getNrOfJoints());
+    configure();
+}
+
+void NLOPT_IK::setOptType(OptType type)
+{
+    opt_type_ = type;
+    configure();
+}
+
+void NLOPT_IK::setAlgorithm(nlopt::algorithm algorithm)
+{
+    algorithm_ = algorithm;
+    configure();
+}
+
+void NLOPT_IK::setXTolAbs(double xtol)
+{
+    xtol_ = xtol;
+    configure();
+}
+
+void NLOPT_IK::configure()
+{
+    if (!valid_) {
+        return;
+    }
+
+    nlopt_ = nlopt::opt(algorithm_, chain_.getNrOfJoints());
 
     std::vector<double> tolerance(1, boost::math::tools::epsilon<float>());
-    nlopt_.set_xtol_abs(tolerance[0]);
+    nlopt_.set_xtol_abs(xtol_);
 
     switch (opt_type_) {
     case Joint:
         nlopt_.set_min_objective(minfunc, this);
-        nlopt_.add_equality_mconstraint(constrainfuncm, this, tolerance);
+        try {
+            nlopt_.add_equality_mconstraint(constrainfuncm, this, tolerance);
+        } catch (const std::invalid_argument&) {
+            // fall back in this optimizer only, so that the requested
+            // algorithm still applies to the other objectives
+            ROS_WARN_NAMED("deterministic_trac_ik", "NLopt algorithm %s does not support equality constraints; using LD_SLSQP for the Joint objective", nlopt_.get_algorithm_name());
+            nlopt_ = nlopt::opt(nlopt::LD_SLSQP, chain_.getNrOfJoints());
+            nlopt_.set_xtol_abs(xtol_);
+            nlopt_.set_min_objective(minfunc, this);
+            nlopt_.add_equality_mconstraint(constrainfuncm, this, tolerance);
+        }
         break;
     case DualQuat:
         nlopt_.set_min_objective(minfuncDQ, this);
@@ -310,16 +351,73 @@ NLOPT_IK::NLOPT_IK(
     }
 }
 
+void NLOPT_IK::setJointLimits(
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max)
+{
+    if (!valid_) {
+        return;
+    }
+
+    assert(q_min.rows() == chain_min_.size());
+    assert(q_max.rows() == chain_max_.size());
+
+    for (size_t i = 0; i < chain_types_.size(); ++i) {
+        joint_min_[i] = std::max(chain_min_[i], q_min(i));
+        joint_max_[i] = std::min(chain_max_[i], q_max(i));
+        if (chain_types_[i] == KDL::BasicJointType::Continuous &&
+            joint_min_[i] > std::numeric_limits<float>::lowest() &&
+            joint_max_[i] < std::numeric_limits<float>::max())
+        {
+            types_[i] = KDL::BasicJointType::RotJoint;
+        } else {
+            types_[i] = chain_types_[i];
+        }
+    }
+}
+
+void NLOPT_IK::resetJointLimits()
+{
+    joint_min_ = chain_min_;
+    joint_max_ = chain_max_;
+    types_ = chain_types_;
+}
+
+void NLOPT_IK::setRandomSeed(uint64_t seed)
+{
+    std::seed_seq seq{ uint32_t(seed), uint32_t(seed >> 32) };
+    rng_.seed(seq);
+}
+
 void NLOPT_IK::restart(
     const KDL::JntArray& q_init,
     const KDL::Frame& p_in)
+{
+    best_residual_ = std::numeric_limits<double>::infinity();
+    f_target_ = p_in;
+    restart_.reset();
+    initialize(q_init);
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    trace_step_ = 0;
+    trace_restarted_ = false;
+#endif
+}
+
+void NLOPT_IK::restart(const KDL::JntArray& q_init)
+{
+    restart_.reset();
+    initialize(q_init);
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    trace_restarted_ = true;
+#endif
+}
+
+void NLOPT_IK::initialize(const KDL::JntArray& q_init)
 {
     assert(q_init.data.size() == types_.size());
 
     progress_ = -3;
 
-    f_target_ = p_in;
-
     //////////////////////////////////////////////////////////////////
     // pre-process initial state to be a valid state for the solver //
     //////////////////////////////////////////////////////////////////
@@ -420,9 +518,19 @@ void NLOPT_IK::restart(
     }
 }
 
-void NLOPT_IK::restart(const KDL::JntArray& q_init)
+void NLOPT_IK::randomize(KDL::JntArray& q)
 {
-    restart(q_init, f_target_);
+    for (size_t j = 0; j < types_.size(); ++j) {
+        if (types_[j] == KDL::BasicJointType::Continuous) {
+            std::uniform_real_distribution<double> dist(
+                    q(j) - 2.0 * M_PI, q(j) + 2.0 * M_PI);
+            q(j) = dist(rng_);
+        } else {
+            std::uniform_real_distribution<double> dist(
+                    joint_min_[j], joint_max_[j]);
+            q(j) = dist(rng_);
+        }
+    }
 }
 
 int NLOPT_IK::step(int steps)
@@ -440,6 +548,8 @@ int NLOPT_IK::step(int steps)
 
     double minf; // the minimum objective value, upon return
 
+    step_residual_ = std::numeric_limits<double>::infinity();
+
     try {
         nlopt_.optimize(best_x_, minf);
     } catch (...) {
@@ -450,9 +560,22 @@ int NLOPT_IK::step(int steps)
             q_out_(i) = best_x_[i];
         }
         return 0;
-    } else {
-        return 1;
     }
+
+    // the optimizer leaves the best point of this step in best_x_
+    for (size_t i = 0; i < best_x_.size(); ++i) {
+        q_tmp_(i) = best_x_[i];
+    }
+    if (restart_.update(q_tmp_, step_residual_, steps)) {
+        if (!restart_.next(q_tmp_, rng_)) {
+            randomize(q_tmp_);
+        }
+        initialize(q_tmp_);
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+        trace_restarted_ = true;
+#endif
+    }
+    return 1;
 }
 
 const KDL::JntArray& NLOPT_IK::qout() const
@@ -507,12 +630,13 @@ void NLOPT_IK::cartSumSquaredError(const double* x, double error[])
 
     KDL::Frame currentPose;
     int rc = fk_solver_.JntToCart(q, currentPose);
+    ++work_.fk;
 
     if (rc < 0) {
         ROS_FATAL_STREAM("KDL FKSolver is failing: " << q.data);
     }
 
-    KDL::Twist delta_twist = KDL::diffRelative(f_target_, currentPose);
+    KDL::Twist delta_twist = KDL::diffRelativeFree(f_target_, currentPose, free_axes_);
 
     for (int i = 0; i < 6; i++) {
         if (std::abs(delta_twist[i]) <= std::abs(bounds_[i])) {
@@ -523,12 +647,35 @@ void NLOPT_IK::cartSumSquaredError(const double* x, double error[])
     error[0] = KDL::dot(delta_twist.vel, delta_twist.vel) +
             KDL::dot(delta_twist.rot, delta_twist.rot);
 
+    updateResidual(delta_twist);
+
     if (KDL::Equal(delta_twist, KDL::Twist::Zero(), eps_)) {
         progress_ = 1;
         std::copy(x, x + chain_.getNrOfJoints(), begin(best_x_));
     }
 }
 
+// Track the smallest residual of the target and of the current step.
+void NLOPT_IK::updateResidual(const KDL::Twist& delta_twist)
+{
+    const double residual = std::sqrt(
+            KDL::dot(delta_twist.vel, delta_twist.vel) +
+            KDL::dot(delta_twist.rot, delta_twist.rot));
+    best_residual_ = std::min(best_residual_, residual);
+    step_residual_ = std::min(step_residual_, residual);
+
+#ifdef DETERMINISTIC_TRAC_IK_TRACE
+    // q_tmp_ holds the evaluated point
+    bool clamped = false;
+    for (size_t i = 0; i < x_min_.size(); ++i) {
+        clamped |= q_tmp_(i) <= x_min_[i] || q_tmp_(i) >= x_max_[i];
+    }
+    DETERMINISTIC_TRAC_IK_TRACE_STEP(trace_, name(), trace_step_, residual, trace_restarted_, clamped);
+    ++trace_step_;
+    trace_restarted_ = false;
+#endif
+}
+
 // Actual function to compute Euclidean distance error. This uses the KDL
 // Forward Kinematics solver to compute the Cartesian pose of the current joint
 // configuration and compares that to the desired Cartesian pose for the IK
@@ -548,12 +695,13 @@ void NLOPT_IK::cartL2NormError(const std::vector<double>& x, double error[])
 
     KDL::Frame currentPose;
     int rc = fk_solver_.JntToCart(q, currentPose);
+    ++work_.fk;
 
     if (rc < 0) {
         ROS_FATAL_STREAM("KDL FKSolver is failing: " << q.data);
     }
 
-    KDL::Twist delta_twist = KDL::diffRelative(f_target_, currentPose);
+    KDL::Twist delta_twist = KDL::diffRelativeFree(f_target_, currentPose, free_axes_);
 
     for (int i = 0; i < 6; i++) {
         if (std::abs(delta_twist[i]) <= std::abs(bounds_[i])) {
@@ -565,6 +713,8 @@ void NLOPT_IK::cartL2NormError(const std::vector<double>& x, double error[])
             KDL::dot(delta_twist.vel, delta_twist.vel) +
             KDL::dot(delta_twist.rot, delta_twist.rot));
 
+    updateResidual(delta_twist);
+
     if (KDL::Equal(delta_twist, KDL::Twist::Zero(), eps_)) {
         progress_ = 1;
         best_x_ = x;
@@ -590,12 +740,13 @@ void NLOPT_IK::cartDQError(const std::vector<double>& x, double error[])
 
     KDL::Frame currentPose;
     int rc = fk_solver_.JntToCart(q, currentPose);
+    ++work_.fk;
 
     if (rc < 0) {
         ROS_FATAL_STREAM("KDL FKSolver is failing: "<<q.data);
     }
 
-    KDL::Twist delta_twist = KDL::diffRelative(f_target_, currentPose);
+    KDL::Twist delta_twist = KDL::diffRelativeFree(f_target_, currentPose, free_axes_);
 
     for (int i = 0; i < 6; i++) {
         if (std::abs(delta_twist[i]) <= std::abs(bounds_[i])) {
@@ -614,6 +765,8 @@ void NLOPT_IK::cartDQError(const std::vector<double>& x, double error[])
     errorDQ.log();
     error[0] = 4.0f * dot(errorDQ, errorDQ);
 
+    updateResidual(delta_twist);
+
     if (KDL::Equal(delta_twist, KDL::Twist::Zero(), eps_)) {
         progress_ = 1;
         best_x_ = x;
@@ -627,7 +780,7 @@ int NLOPT_IK::CartToJnt(
     const KDL::Twist _bounds,
     const KDL::JntArray& q_desired)
 {
-    bounds_ = _bounds;
+    setBounds(_bounds);
     restart(q_init, p_in);
 
     const int max_iterations = 100;
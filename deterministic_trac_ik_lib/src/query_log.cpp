@@ -0,0 +1,452 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/query_log.hpp>
+
+// standard includes
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// system includes
+#include <fcntl.h>
+#include <ros/ros.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// project includes
+#include <deterministic_trac_ik/utils.h>
+
+namespace Deterministic_TRAC_IK {
+
+static const char LogMagic[8] = { 'D', 'T', 'I', 'K', 'Q', 'L', 'O', 'G' };
+static const uint32_t LogVersion = 3;
+
+// compared and stored as raw bytes, so it must not have padding
+static_assert(sizeof(SolverOptions) == 13 * sizeof(double) + 12 * sizeof(int32_t), "SolverOptions must not have padding");
+
+// file layout: Header, then capacity slots of a RecordHeader followed by
+// double seed[num_joints], double consistency_limits[num_joints], and
+// double solution[num_joints]. Writers, possibly in several processes,
+// claim slots by atomically incrementing count.
+struct QueryLog::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_joints;
+    uint64_t capacity;
+    uint64_t chain_signature;
+    SolverOptions options;
+    uint64_t count;
+};
+
+namespace {
+
+enum RecordFlags
+{
+    HasConsistencyLimits = 1 << 0,
+    Filtered = 1 << 1,
+    PerQuerySeeding = 1 << 2
+};
+
+struct RecordHeader
+{
+    // one more than the index of the record in the slot once it is
+    // completely written, 0 while it is being written
+    uint64_t sequence;
+    double p[3];
+    double M[9];
+    double bounds[6];
+    double eps;
+    double cost_budget;
+    uint64_t seed_salt;
+    uint64_t duration_ns;
+    int32_t solve_type;
+    int32_t max_iterations;
+    int32_t result;
+    uint32_t iterations;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+size_t RecordSize(unsigned int num_joints)
+{
+    return sizeof(RecordHeader) + 3 * num_joints * sizeof(double);
+}
+
+void WriteJoints(const KDL::JntArray& q, unsigned int num_joints, double* out)
+{
+    for (unsigned int j = 0; j < num_joints; ++j) {
+        out[j] = j < q.rows() ? q(j) : 0.0;
+    }
+}
+
+void ReadJoints(const double* in, unsigned int num_joints, KDL::JntArray& q)
+{
+    q.resize(num_joints);
+    for (unsigned int j = 0; j < num_joints; ++j) {
+        q(j) = in[j];
+    }
+}
+
+} // namespace
+
+SolverOptions::SolverOptions() :
+    singularity_threshold(0.0),
+    max_damping(0.0),
+    nullspace_gain(0.0),
+    nlopt_xtol(0.0),
+    coarse_eps(0.0),
+    candidate_eps(0.0),
+    stagnation_threshold(0.0),
+    stagnation_min_improvement(0.0),
+    restart_plateau_improvement(0.0),
+    restart_perturbation(0.0),
+    cost_fk(0.0),
+    cost_jacobian(0.0),
+    cost_svd(0.0),
+    vel_solver(0),
+    nullspace_objective(0),
+    nlopt_type(0),
+    nlopt_algorithm(0),
+    line_search(0),
+    active_set(0),
+    stagnation_patience(0),
+    restart_plateau_window(0),
+    restart_max_steps(0),
+    restart_sampling(0),
+    compiled_chain(0),
+    external(0)
+{
+}
+
+bool SolverOptions::operator==(const SolverOptions& other) const
+{
+    return std::memcmp(this, &other, sizeof(SolverOptions)) == 0;
+}
+
+QueryRecord::QueryRecord() :
+    pose(),
+    seed(),
+    bounds(KDL::Twist::Zero()),
+    consistency_limits(),
+    solve_type(0),
+    max_iterations(0),
+    eps(0.0),
+    per_query_seeding(false),
+    seed_salt(0),
+    cost_budget(0.0),
+    filtered(false),
+    result(0),
+    solution(),
+    iterations(0),
+    duration_ns(0)
+{
+}
+
+QueryLog::QueryLog() :
+    mapping_(nullptr),
+    mapping_size_(0),
+    header_(nullptr),
+    record_size_(0)
+{
+}
+
+QueryLog::~QueryLog()
+{
+    close();
+}
+
+bool QueryLog::open(
+    const std::string& path,
+    unsigned int num_joints,
+    uint64_t capacity,
+    uint64_t chain_signature,
+    const SolverOptions& options)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        header_ = nullptr;
+    }
+
+    if (capacity == 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Query log '%s' must hold at least one record", path.c_str());
+        return false;
+    }
+
+    // the lock keeps other instances from checking or replacing the file
+    // until it has a valid header
+    int fd = OpenLocked(path);
+    if (fd < 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open query log '%s'", path.c_str());
+        return false;
+    }
+
+    const size_t record_size = RecordSize(num_joints);
+    const size_t size = sizeof(Header) + capacity * record_size;
+
+    // keep appending to a log of the same layout and chain
+    bool append = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+        Header existing;
+        if (pread(fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing)) {
+            append =
+                    std::memcmp(existing.magic, LogMagic, sizeof(LogMagic)) == 0 &&
+                    existing.version == LogVersion &&
+                    existing.num_joints == num_joints &&
+                    existing.capacity == capacity &&
+                    existing.chain_signature == chain_signature &&
+                    existing.options == options;
+        }
+    }
+
+    // replace any other file with a new one rather than resizing it, since
+    // other instances, e.g. of another group, may still have it mapped
+    int new_fd = -1;
+    const std::string tmp_path = path + ".tmp";
+    if (!append) {
+        new_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (new_fd < 0 || ftruncate(new_fd, size) != 0) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to allocate query log '%s'", path.c_str());
+            if (new_fd >= 0) {
+                ::close(new_fd);
+                unlink(tmp_path.c_str());
+            }
+            ::close(fd);
+            return false;
+        }
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, append ? fd : new_fd, 0);
+    if (mapping == MAP_FAILED) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to map query log '%s'", path.c_str());
+        if (!append) {
+            ::close(new_fd);
+            unlink(tmp_path.c_str());
+        }
+        ::close(fd);
+        return false;
+    }
+
+    if (!append) {
+        Header* header = (Header*)mapping;
+        std::memcpy(header->magic, LogMagic, sizeof(LogMagic));
+        header->version = LogVersion;
+        header->num_joints = num_joints;
+        header->capacity = capacity;
+        header->chain_signature = chain_signature;
+        header->options = options;
+        header->count = 0;
+
+        ::close(new_fd);
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to replace query log '%s'", path.c_str());
+            munmap(mapping, size);
+            unlink(tmp_path.c_str());
+            ::close(fd);
+            return false;
+        }
+    }
+
+    // a mapping of the file keeps its lock until it is released explicitly
+    flock(fd, LOCK_UN);
+    ::close(fd);
+
+    mapping_ = mapping;
+    mapping_size_ = size;
+    header_ = (Header*)mapping;
+    record_size_ = record_size;
+    return true;
+}
+
+void QueryLog::close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        header_ = nullptr;
+    }
+}
+
+void QueryLog::record(const QueryRecord& record)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!header_) {
+        return;
+    }
+
+    // claim a slot; other instances may be appending to the same file
+    const uint64_t index = __atomic_fetch_add(&header_->count, 1, __ATOMIC_RELAXED);
+
+    const unsigned int n = header_->num_joints;
+    char* slot = (char*)mapping_ + sizeof(Header) +
+            (index % header_->capacity) * record_size_;
+
+    RecordHeader& rh = *(RecordHeader*)slot;
+    __atomic_store_n(&rh.sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i = 0; i < 3; ++i) {
+        rh.p[i] = record.pose.p[i];
+    }
+    for (int i = 0; i < 9; ++i) {
+        rh.M[i] = record.pose.M.data[i];
+    }
+    for (int i = 0; i < 6; ++i) {
+        rh.bounds[i] = record.bounds[i];
+    }
+    rh.eps = record.eps;
+    rh.cost_budget = record.cost_budget;
+    rh.seed_salt = record.seed_salt;
+    rh.duration_ns = record.duration_ns;
+    rh.solve_type = record.solve_type;
+    rh.max_iterations = record.max_iterations;
+    rh.result = record.result;
+    rh.iterations = record.iterations;
+    rh.flags =
+            (record.consistency_limits.rows() != 0 ? HasConsistencyLimits : 0) |
+            (record.filtered ? Filtered : 0) |
+            (record.per_query_seeding ? PerQuerySeeding : 0);
+    rh.reserved = 0;
+
+    double* joints = (double*)(slot + sizeof(RecordHeader));
+    WriteJoints(record.seed, n, joints);
+    WriteJoints(record.consistency_limits, n, joints + n);
+    WriteJoints(record.result >= 0 ? record.solution : KDL::JntArray(), n, joints + 2 * n);
+
+    __atomic_store_n(&rh.sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t QueryLog::count() const
+{
+    return header_ ? __atomic_load_n(&header_->count, __ATOMIC_RELAXED) : 0;
+}
+
+bool QueryLog::read(
+    const std::string& path,
+    std::vector<QueryRecord>& records,
+    uint64_t& chain_signature,
+    SolverOptions& options)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open query log '%s'", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    Header header;
+    bool ok = fstat(fd, &st) == 0 &&
+            pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+            std::memcmp(header.magic, LogMagic, sizeof(LogMagic)) == 0 &&
+            header.version == LogVersion &&
+            header.capacity > 0 &&
+            (size_t)st.st_size >= sizeof(header) &&
+            header.capacity <= ((size_t)st.st_size - sizeof(header)) / RecordSize(header.num_joints) &&
+            (size_t)st.st_size == sizeof(header) + header.capacity * RecordSize(header.num_joints);
+
+    void* mapping = MAP_FAILED;
+    if (ok) {
+        mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (!ok || mapping == MAP_FAILED) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "'%s' is not a valid query log", path.c_str());
+        return false;
+    }
+
+    const unsigned int n = header.num_joints;
+    const size_t record_size = RecordSize(n);
+    const uint64_t size = std::min(header.count, header.capacity);
+    const uint64_t first = header.count - size;
+
+    records.clear();
+    records.reserve(size);
+    for (uint64_t i = first; i < header.count; ++i) {
+        const char* slot = (const char*)mapping + sizeof(header) +
+                (i % header.capacity) * record_size;
+        const RecordHeader& rh = *(const RecordHeader*)slot;
+        const double* joints = (const double*)(slot + sizeof(RecordHeader));
+
+        // skip records still being written, or already overwritten
+        if (__atomic_load_n(&rh.sequence, __ATOMIC_ACQUIRE) != i + 1) {
+            continue;
+        }
+
+        QueryRecord record;
+        record.pose = KDL::Frame(
+                KDL::Rotation(
+                        rh.M[0], rh.M[1], rh.M[2],
+                        rh.M[3], rh.M[4], rh.M[5],
+                        rh.M[6], rh.M[7], rh.M[8]),
+                KDL::Vector(rh.p[0], rh.p[1], rh.p[2]));
+        for (int k = 0; k < 6; ++k) {
+            record.bounds[k] = rh.bounds[k];
+        }
+        record.eps = rh.eps;
+        record.cost_budget = rh.cost_budget;
+        record.seed_salt = rh.seed_salt;
+        record.duration_ns = rh.duration_ns;
+        record.solve_type = rh.solve_type;
+        record.max_iterations = rh.max_iterations;
+        record.result = rh.result;
+        record.iterations = rh.iterations;
+        record.filtered = (rh.flags & Filtered) != 0;
+        record.per_query_seeding = (rh.flags & PerQuerySeeding) != 0;
+
+        ReadJoints(joints, n, record.seed);
+        if (rh.flags & HasConsistencyLimits) {
+            ReadJoints(joints + n, n, record.consistency_limits);
+        }
+        if (rh.result >= 0) {
+            ReadJoints(joints + 2 * n, n, record.solution);
+        }
+
+        // and skip it if it was overwritten while being read
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&rh.sequence, __ATOMIC_RELAXED) != i + 1) {
+            continue;
+        }
+        records.push_back(record);
+    }
+
+    chain_signature = header.chain_signature;
+    options = header.options;
+    munmap(mapping, st.st_size);
+    return true;
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -0,0 +1,430 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/reachability_map.hpp>
+
+// standard includes
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+
+// system includes
+#include <fcntl.h>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <ros/ros.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// project includes
+#include <deterministic_trac_ik/analytic_solver.hpp>
+#include <deterministic_trac_ik/kdl_tl.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+static const char MapMagic[8] = { 'D', 'T', 'I', 'K', 'R', 'E', 'A', 'C' };
+static const uint32_t MapVersion = 1;
+
+struct ReachabilityMap::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t orientation_bins;
+    uint64_t signature;
+    double resolution;
+    double origin[3];
+    int32_t dims[3];
+    int32_t reserved;
+};
+
+// bitmask of the bins whose centers are within ~45 degrees of each bin's
+// center, i.e. the bin itself and its neighbors on the cube map
+static std::vector<uint64_t> MakeBinNeighbors()
+{
+    std::vector<KDL::Vector> centers;
+    for (int face = 0; face < 6; ++face) {
+        for (int iu = 0; iu < 3; ++iu) {
+            for (int iv = 0; iv < 3; ++iv) {
+                double c[3];
+                const int major = face / 2;
+                c[major] = (face % 2) ? -1.0 : 1.0;
+                c[(major + 1) % 3] = (iu - 1) * 2.0 / 3.0;
+                c[(major + 2) % 3] = (iv - 1) * 2.0 / 3.0;
+                KDL::Vector v(c[0], c[1], c[2]);
+                v.Normalize();
+                centers.push_back(v);
+            }
+        }
+    }
+
+    const double min_cos = std::cos(50.0 * M_PI / 180.0);
+    std::vector<uint64_t> neighbors(centers.size(), 0);
+    for (size_t i = 0; i < centers.size(); ++i) {
+        for (size_t j = 0; j < centers.size(); ++j) {
+            if (KDL::dot(centers[i], centers[j]) >= min_cos) {
+                neighbors[i] |= uint64_t(1) << j;
+            }
+        }
+    }
+    return neighbors;
+}
+
+ReachabilityMap::ReachabilityMap()
+:
+    signature_(0),
+    resolution_(0.0),
+    origin_(),
+    dims_(),
+    storage_(),
+    mapping_(nullptr),
+    mapping_size_(0),
+    masks_(nullptr)
+{
+}
+
+ReachabilityMap::~ReachabilityMap()
+{
+    unmap();
+}
+
+void ReachabilityMap::unmap()
+{
+    if (mapping_) {
+        munmap(mapping_, mapping_size_);
+        mapping_ = nullptr;
+        mapping_size_ = 0;
+    }
+    masks_ = storage_.empty() ? nullptr : storage_.data();
+}
+
+int ReachabilityMap::orientationBin(const KDL::Vector& axis)
+{
+    int major = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (std::abs(axis(i)) > std::abs(axis(major))) {
+            major = i;
+        }
+    }
+
+    const double m = std::abs(axis(major));
+    if (m == 0.0) {
+        return 0;
+    }
+
+    const int face = 2 * major + (axis(major) < 0.0 ? 1 : 0);
+    const double u = axis((major + 1) % 3) / m;
+    const double v = axis((major + 2) % 3) / m;
+    const int iu = std::min(2, (int)((u + 1.0) * 1.5));
+    const int iv = std::min(2, (int)((v + 1.0) * 1.5));
+    return face * 9 + iu * 3 + iv;
+}
+
+bool ReachabilityMap::voxel(const KDL::Vector& p, int32_t v[3]) const
+{
+    for (int i = 0; i < 3; ++i) {
+        const double c = std::floor((p(i) - origin_[i]) / resolution_);
+        if (c < 0.0 || c >= dims_[i]) {
+            return false;
+        }
+        v[i] = (int32_t)c;
+    }
+    return true;
+}
+
+bool ReachabilityMap::build(
+    const KDL::Chain& chain,
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max,
+    double resolution,
+    uint64_t num_samples,
+    unsigned int num_threads,
+    unsigned int seed)
+{
+    const unsigned int nj = chain.getNrOfJoints();
+    if (q_min.data.size() != nj || q_max.data.size() != nj || resolution <= 0.0) {
+        return false;
+    }
+
+    // bound the workspace by the sum of all offsets along the chain and the
+    // travel of prismatic joints
+    double reach = 0.0;
+    unsigned int j = 0;
+    for (unsigned int i = 0; i < chain.getNrOfSegments(); ++i) {
+        const KDL::Segment& segment = chain.getSegment(i);
+        reach += segment.getFrameToTip().p.Norm();
+        if (segment.getJoint().getType() != KDL::Joint::None) {
+            reach += 2.0 * segment.getJoint().JointOrigin().Norm();
+            if (KDL::ClassifyJoint(segment.getJoint(), q_min(j), q_max(j)) == KDL::BasicJointType::TransJoint) {
+                reach += std::max(std::abs(q_min(j)), std::abs(q_max(j)));
+            }
+            ++j;
+        }
+    }
+    reach += resolution;
+
+    unmap();
+
+    signature_ = ChainSignature(chain);
+    resolution_ = resolution;
+    for (int i = 0; i < 3; ++i) {
+        dims_[i] = (int32_t)std::ceil(2.0 * reach / resolution);
+        origin_[i] = -0.5 * dims_[i] * resolution;
+    }
+
+    const size_t num_voxels = (size_t)dims_[0] * dims_[1] * dims_[2];
+    std::unique_ptr<std::atomic<uint64_t>[]> hits(new std::atomic<uint64_t>[num_voxels]);
+    for (size_t i = 0; i < num_voxels; ++i) {
+        hits[i].store(0, std::memory_order_relaxed);
+    }
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    auto sample = [&](unsigned int t) {
+        KDL::ChainFkSolverPos_recursive fk_solver(chain);
+        std::mt19937_64 rng(seed + t);
+        std::vector<std::uniform_real_distribution<double>> dists;
+        for (unsigned int j = 0; j < nj; ++j) {
+            double lo = q_min(j);
+            double hi = q_max(j);
+            if (lo <= std::numeric_limits<float>::lowest() ||
+                hi >= std::numeric_limits<float>::max())
+            {
+                lo = -M_PI;
+                hi = M_PI;
+            }
+            dists.emplace_back(lo, hi);
+        }
+
+        KDL::JntArray q(nj);
+        KDL::Frame p;
+        const uint64_t count = num_samples / num_threads + (t < num_samples % num_threads ? 1 : 0);
+        for (uint64_t s = 0; s < count; ++s) {
+            for (unsigned int j = 0; j < nj; ++j) {
+                q(j) = dists[j](rng);
+            }
+            fk_solver.JntToCart(q, p);
+
+            int32_t v[3];
+            if (!voxel(p.p, v)) {
+                continue;
+            }
+            const uint64_t bit = uint64_t(1) << orientationBin(p.M.UnitZ());
+            hits[index(v[0], v[1], v[2])].fetch_or(bit, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < num_threads; ++t) {
+        threads.emplace_back(sample, t);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // dilate orientations, then positions
+    const std::vector<uint64_t> neighbors = MakeBinNeighbors();
+    std::vector<uint64_t> dilated(num_voxels, 0);
+    for (size_t i = 0; i < num_voxels; ++i) {
+        uint64_t mask = hits[i].load(std::memory_order_relaxed);
+        uint64_t out = 0;
+        while (mask) {
+            const int b = __builtin_ctzll(mask);
+            out |= neighbors[b];
+            mask &= mask - 1;
+        }
+        dilated[i] = out;
+    }
+
+    storage_.assign(num_voxels, 0);
+    for (int32_t z = 0; z < dims_[2]; ++z) {
+    for (int32_t y = 0; y < dims_[1]; ++y) {
+    for (int32_t x = 0; x < dims_[0]; ++x) {
+        uint64_t out = 0;
+        for (int32_t dz = std::max(0, z - 1); dz <= std::min(dims_[2] - 1, z + 1); ++dz) {
+        for (int32_t dy = std::max(0, y - 1); dy <= std::min(dims_[1] - 1, y + 1); ++dy) {
+        for (int32_t dx = std::max(0, x - 1); dx <= std::min(dims_[0] - 1, x + 1); ++dx) {
+            out |= dilated[index(dx, dy, dz)];
+        }
+        }
+        }
+        storage_[index(x, y, z)] = out;
+    }
+    }
+    }
+
+    masks_ = storage_.data();
+    return true;
+}
+
+bool ReachabilityMap::save(const std::string& path) const
+{
+    if (!valid()) {
+        return false;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open reachability map file '%s' for writing", path.c_str());
+        return false;
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MapMagic, sizeof(MapMagic));
+    header.version = MapVersion;
+    header.orientation_bins = OrientationBins;
+    header.signature = signature_;
+    header.resolution = resolution_;
+    for (int i = 0; i < 3; ++i) {
+        header.origin[i] = origin_[i];
+        header.dims[i] = dims_[i];
+    }
+
+    const size_t num_voxels = (size_t)dims_[0] * dims_[1] * dims_[2];
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)masks_, num_voxels * sizeof(uint64_t));
+    return (bool)out;
+}
+
+bool ReachabilityMap::load(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open reachability map file '%s'", path.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Reachability map file '%s' is truncated", path.c_str());
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to map reachability map file '%s'", path.c_str());
+        return false;
+    }
+
+    const Header& header = *(const Header*)mapping;
+    const size_t num_voxels = (size_t)std::max(0, header.dims[0]) * std::max(0, header.dims[1]) * std::max(0, header.dims[2]);
+    if (std::memcmp(header.magic, MapMagic, sizeof(MapMagic)) != 0 ||
+        header.version != MapVersion ||
+        header.orientation_bins != OrientationBins ||
+        !(header.resolution > 0.0) ||
+        (size_t)st.st_size != sizeof(Header) + num_voxels * sizeof(uint64_t))
+    {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "'%s' is not a valid reachability map", path.c_str());
+        munmap(mapping, st.st_size);
+        return false;
+    }
+
+    storage_.clear();
+    storage_.shrink_to_fit();
+    unmap();
+
+    mapping_ = mapping;
+    mapping_size_ = st.st_size;
+    signature_ = header.signature;
+    resolution_ = header.resolution;
+    for (int i = 0; i < 3; ++i) {
+        origin_[i] = header.origin[i];
+        dims_[i] = header.dims[i];
+    }
+    masks_ = (const uint64_t*)((const char*)mapping + sizeof(Header));
+    return true;
+}
+
+bool ReachabilityMap::reachable(
+    const KDL::Frame& p,
+    const KDL::Twist& bounds) const
+{
+    if (!valid()) {
+        return true;
+    }
+
+    // widen the search by the translational tolerance, which is given in
+    // the target frame; a free axis admits any position
+    double slack = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        const double b = std::abs(bounds.vel(i));
+        if (b >= std::numeric_limits<float>::max()) {
+            return true;
+        }
+        slack = std::max(slack, b);
+    }
+
+    uint64_t bins = ~uint64_t(0);
+    if (bounds.rot.x() == 0.0 && bounds.rot.y() == 0.0 && bounds.rot.z() == 0.0) {
+        bins = uint64_t(1) << orientationBin(p.M.UnitZ());
+    }
+
+    // the tolerance box is rotated with the target frame, so its corners
+    // reach up to sqrt(3) times its half-width along the axes of the map
+    const int32_t r = (int32_t)std::ceil(slack * std::sqrt(3.0) / resolution_);
+    if (r == 0) {
+        int32_t v[3];
+        return voxel(p.p, v) && (masks_[index(v[0], v[1], v[2])] & bins);
+    }
+
+    int32_t lo[3];
+    int32_t hi[3];
+    for (int i = 0; i < 3; ++i) {
+        const double c = std::floor((p.p(i) - origin_[i]) / resolution_);
+        lo[i] = (int32_t)std::max(0.0, c - r);
+        hi[i] = (int32_t)std::min(dims_[i] - 1.0, c + r);
+        if (lo[i] > hi[i]) {
+            return false;
+        }
+    }
+
+    for (int32_t z = lo[2]; z <= hi[2]; ++z) {
+        for (int32_t y = lo[1]; y <= hi[1]; ++y) {
+            for (int32_t x = lo[0]; x <= hi[0]; ++x) {
+                if (masks_[index(x, y, z)] & bins) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -0,0 +1,128 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/restart_policy.hpp>
+
+// standard includes
+#include <algorithm>
+#include <limits>
+
+namespace Deterministic_TRAC_IK {
+
+RestartCounters& RestartCounters::operator+=(const RestartCounters& other)
+{
+    stalls += other.stalls;
+    plateaus += other.plateaus;
+    step_limits += other.step_limits;
+    perturbations += other.perturbations;
+    return *this;
+}
+
+RestartMonitor::RestartMonitor() :
+    policy_(),
+    counters_(),
+    best_q_(),
+    best_residual_(std::numeric_limits<double>::infinity()),
+    attempt_steps_(0),
+    attempt_residual_(std::numeric_limits<double>::infinity()),
+    window_steps_(0),
+    window_residual_(std::numeric_limits<double>::infinity()),
+    ended_by_policy_(false)
+{
+}
+
+void RestartMonitor::reset()
+{
+    best_residual_ = std::numeric_limits<double>::infinity();
+    beginAttempt();
+}
+
+bool RestartMonitor::update(const KDL::JntArray& q, double residual, int steps)
+{
+    if (policy_.sampling == RestartPolicy::Perturb && residual < best_residual_) {
+        best_residual_ = residual;
+        best_q_ = q;
+    }
+
+    attempt_steps_ += steps;
+    attempt_residual_ = std::min(attempt_residual_, residual);
+
+    if (policy_.max_steps > 0 && attempt_steps_ >= policy_.max_steps) {
+        ++counters_.step_limits;
+        ended_by_policy_ = true;
+        return true;
+    }
+
+    if (policy_.plateau_window > 0) {
+        window_steps_ += steps;
+        if (window_steps_ >= policy_.plateau_window) {
+            if (attempt_residual_ > window_residual_ * (1.0 - policy_.plateau_improvement)) {
+                ++counters_.plateaus;
+                ended_by_policy_ = true;
+                return true;
+            }
+            window_steps_ = 0;
+            window_residual_ = attempt_residual_;
+        }
+    }
+
+    return false;
+}
+
+bool RestartMonitor::next(KDL::JntArray& q, std::default_random_engine& rng)
+{
+    const bool ended_by_policy = ended_by_policy_;
+    beginAttempt();
+
+    if (!ended_by_policy ||
+        policy_.sampling != RestartPolicy::Perturb ||
+        best_residual_ == std::numeric_limits<double>::infinity())
+    {
+        return false;
+    }
+
+    std::uniform_real_distribution<double> dist(-policy_.perturbation, policy_.perturbation);
+    for (unsigned int j = 0; j < q.data.size(); ++j) {
+        q(j) = best_q_(j) + dist(rng);
+    }
+    ++counters_.perturbations;
+    return true;
+}
+
+void RestartMonitor::beginAttempt()
+{
+    attempt_steps_ = 0;
+    attempt_residual_ = std::numeric_limits<double>::infinity();
+    window_steps_ = 0;
+    window_residual_ = std::numeric_limits<double>::infinity();
+    ended_by_policy_ = false;
+}
+
+} // namespace Deterministic_TRAC_IK
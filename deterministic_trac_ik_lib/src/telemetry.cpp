@@ -0,0 +1,222 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/telemetry.hpp>
+
+// standard includes
+#include <algorithm>
+#include <fstream>
+
+// system includes
+#include <ros/ros.h>
+
+namespace Deterministic_TRAC_IK {
+
+Histogram::Histogram() :
+    count_(0),
+    sum_(0),
+    max_(0)
+{
+    for (int i = 0; i < NumBuckets; ++i) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+int Histogram::bucket(uint64_t value)
+{
+    const int sub_buckets = 1 << SubBucketBits;
+    if (value < 2 * sub_buckets) {
+        return (int)value;
+    }
+
+    // position of the highest set bit, >= SubBucketBits + 1
+    int msb = 63;
+    while (!(value & (uint64_t(1) << msb))) {
+        --msb;
+    }
+
+    // keep the SubBucketBits bits below the highest one
+    const int shift = msb - SubBucketBits;
+    const int b = 2 * sub_buckets +
+            ((shift - 1) << SubBucketBits) + (int)((value >> shift) - sub_buckets);
+    return std::min(b, NumBuckets - 1);
+}
+
+uint64_t Histogram::bucketUpperBound(int bucket)
+{
+    const int sub_buckets = 1 << SubBucketBits;
+    if (bucket < 2 * sub_buckets) {
+        return bucket;
+    }
+
+    const int shift = ((bucket - 2 * sub_buckets) >> SubBucketBits) + 1;
+    const uint64_t sub = ((bucket - 2 * sub_buckets) & (sub_buckets - 1)) + sub_buckets;
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+    counts_[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max &&
+        !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    { }
+}
+
+double Histogram::mean() const
+{
+    const uint64_t count = this->count();
+    return count == 0 ? 0.0 : (double)sum_.load(std::memory_order_relaxed) / count;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+    // the buckets may have moved on since count() was read, so the rank is
+    // clamped to what they hold
+    uint64_t total = 0;
+    for (int i = 0; i < NumBuckets; ++i) {
+        total += counts_[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, std::min<uint64_t>(total, (uint64_t)(p * total + 0.5)));
+    uint64_t seen = 0;
+    for (int i = 0; i < NumBuckets; ++i) {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+void Histogram::reset()
+{
+    for (int i = 0; i < NumBuckets; ++i) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+IKTelemetry::IKTelemetry() :
+    successes(0),
+    failures(0),
+    callback_rejections(0),
+    iterations_used(0),
+    iterations_budget(0)
+{
+}
+
+void IKTelemetry::recordIK(
+    bool success,
+    uint64_t duration_ns,
+    uint64_t iterations,
+    uint64_t budget)
+{
+    ik_latency.record(duration_ns);
+    if (success) {
+        successes.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        failures.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    iterations_used.fetch_add(iterations, std::memory_order_relaxed);
+    iterations_budget.fetch_add(budget, std::memory_order_relaxed);
+    if (budget > 0) {
+        budget_utilization.record(std::min(iterations, budget) * 100 / budget);
+    }
+}
+
+static void WriteHistogram(
+    std::ostream& os,
+    const char* name,
+    const Histogram& histogram,
+    double scale)
+{
+    os << "  " << name << ":\n";
+    os << "    count: " << histogram.count() << "\n";
+    os << "    mean: " << histogram.mean() * scale << "\n";
+    os << "    p50: " << histogram.percentile(0.5) * scale << "\n";
+    os << "    p90: " << histogram.percentile(0.9) * scale << "\n";
+    os << "    p99: " << histogram.percentile(0.99) * scale << "\n";
+    os << "    p999: " << histogram.percentile(0.999) * scale << "\n";
+    os << "    max: " << histogram.max() * scale << "\n";
+}
+
+void IKTelemetry::write(std::ostream& os, const std::string& name) const
+{
+    os << name << ":\n";
+    os << "  successes: " << successes.load(std::memory_order_relaxed) << "\n";
+    os << "  failures: " << failures.load(std::memory_order_relaxed) << "\n";
+    os << "  callback_rejections: " << callback_rejections.load(std::memory_order_relaxed) << "\n";
+    os << "  iterations_used: " << iterations_used.load(std::memory_order_relaxed) << "\n";
+    os << "  iterations_budget: " << iterations_budget.load(std::memory_order_relaxed) << "\n";
+    WriteHistogram(os, "ik_latency_us", ik_latency, 1e-3);
+    WriteHistogram(os, "fk_latency_us", fk_latency, 1e-3);
+    WriteHistogram(os, "budget_utilization_percent", budget_utilization, 1.0);
+}
+
+bool IKTelemetry::save(const std::string& path, const std::string& name) const
+{
+    std::ofstream ofs(path.c_str());
+    if (!ofs) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to open telemetry file '%s'", path.c_str());
+        return false;
+    }
+
+    write(ofs, name);
+    if (!ofs) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to write telemetry file '%s'", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void IKTelemetry::reset()
+{
+    ik_latency.reset();
+    fk_latency.reset();
+    budget_utilization.reset();
+    successes.store(0, std::memory_order_relaxed);
+    failures.store(0, std::memory_order_relaxed);
+    callback_rejections.store(0, std::memory_order_relaxed);
+    iterations_used.store(0, std::memory_order_relaxed);
+    iterations_budget.store(0, std::memory_order_relaxed);
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -0,0 +1,423 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/tree_ik_solver.hpp>
+
+// standard includes
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// system includes
+#include <boost/math/tools/precision.hpp>
+#include <kdl/chain.hpp>
+#include <ros/ros.h>
+
+// project includes
+#include <deterministic_trac_ik/utils.h>
+
+namespace Deterministic_TRAC_IK {
+
+TreeIkSolver::TreeIkSolver(
+    const KDL::Tree& tree,
+    const std::string& base_name,
+    const std::vector<std::string>& tip_names,
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max,
+    int max_iters,
+    double eps)
+:
+    valid_(false),
+    segments_(),
+    tips_(),
+    chain_min_(q_min),
+    chain_max_(q_max),
+    chain_types_(),
+    joint_min_(q_min),
+    joint_max_(q_max),
+    joint_types_(),
+    max_iters_(max_iters),
+    eps_(eps),
+    damping_(KDL::DefaultDamping(KDL::VelSolverDLS)),
+    iterations_(0),
+    rng_(),
+    per_query_seeding_(false),
+    seed_salt_(0),
+    q_curr_(q_min.rows()),
+    q_next_(q_min.rows())
+{
+    // merge the chains to each tip, sharing the segments they have in common
+    for (const std::string& tip_name : tip_names) {
+        KDL::Chain chain;
+        if (!tree.getChain(base_name, tip_name, chain) || chain.getNrOfSegments() == 0) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Couldn't find chain %s to %s", base_name.c_str(), tip_name.c_str());
+            segments_.clear();
+            tips_.clear();
+            return;
+        }
+
+        Tip tip;
+        tip.segment = -1;
+        tip.free_axes = 0;
+        for (const KDL::Segment& segment : chain.segments) {
+            int index = findSegment(segment.getName());
+            if (index < 0) {
+                TreeSegment tree_segment;
+                tree_segment.segment = segment;
+                tree_segment.parent = tip.segment;
+                tree_segment.joint = -1;
+                if (segment.getJoint().getType() != KDL::Joint::None) {
+                    tree_segment.joint = chain_types_.size();
+                    if (tree_segment.joint >= (int)q_min.rows() || tree_segment.joint >= (int)q_max.rows()) {
+                        ROS_ERROR_NAMED("deterministic_trac_ik", "The chains to the tips have more joints than their limits");
+                        segments_.clear();
+                        tips_.clear();
+                        return;
+                    }
+                    chain_types_.push_back(KDL::ClassifyJoint(
+                            segment.getJoint(),
+                            q_min(tree_segment.joint),
+                            q_max(tree_segment.joint)));
+                }
+                index = segments_.size();
+                segments_.push_back(tree_segment);
+            }
+
+            if (segments_[index].joint >= 0) {
+                tip.joint_segments.push_back(index);
+            }
+            tip.segment = index;
+        }
+        tips_.push_back(tip);
+    }
+
+    if (chain_types_.size() != q_min.rows() || chain_types_.size() != q_max.rows()) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "The chains to the tips have fewer joints than their limits");
+        segments_.clear();
+        tips_.clear();
+        return;
+    }
+    joint_types_ = chain_types_;
+
+    frames_.resize(segments_.size());
+    twists_.resize(segments_.size());
+    delta_q_.resize(chain_types_.size());
+    valid_ = true;
+}
+
+void TreeIkSolver::setJointLimits(
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max)
+{
+    assert(q_min.data.size() == chain_min_.data.size());
+    assert(q_max.data.size() == chain_max_.data.size());
+
+    for (size_t j = 0; j < chain_types_.size(); ++j) {
+        joint_min_(j) = std::max(chain_min_(j), q_min(j));
+        joint_max_(j) = std::min(chain_max_(j), q_max(j));
+        if (chain_types_[j] == KDL::BasicJointType::Continuous &&
+            joint_min_(j) > std::numeric_limits<float>::lowest() &&
+            joint_max_(j) < std::numeric_limits<float>::max())
+        {
+            joint_types_[j] = KDL::BasicJointType::RotJoint;
+        } else {
+            joint_types_[j] = chain_types_[j];
+        }
+    }
+}
+
+void TreeIkSolver::resetJointLimits()
+{
+    joint_min_ = chain_min_;
+    joint_max_ = chain_max_;
+    joint_types_ = chain_types_;
+}
+
+int TreeIkSolver::CartToJnt(
+    const KDL::JntArray& q_init,
+    const std::vector<KDL::Frame>& p_in,
+    KDL::JntArray& q_out,
+    const std::vector<KDL::Twist>& bounds,
+    const SolutionFilter& filter)
+{
+    iterations_ = 0;
+    if (!valid_) {
+        return NoSolution;
+    }
+
+    assert(q_init.rows() == chain_types_.size());
+    assert(p_in.size() == tips_.size());
+    assert(bounds.empty() || bounds.size() == tips_.size());
+
+    size_t num_rows = 0;
+    for (size_t k = 0; k < tips_.size(); ++k) {
+        Tip& tip = tips_[k];
+        tip.target = p_in[k];
+        tip.bounds = bounds.empty() ? KDL::Twist::Zero() : bounds[k];
+        tip.free_axes = KDL::FreeAxes(tip.bounds);
+        tip.rows.clear();
+        for (int i = 0; i < 6; ++i) {
+            if (!(tip.free_axes & (1u << i))) {
+                tip.rows.push_back(i);
+            }
+        }
+        num_rows += tip.rows.size();
+    }
+
+    jac_.resize(num_rows, chain_types_.size());
+    err_.resize(num_rows);
+
+    if (per_query_seeding_) {
+        uint64_t hash = HashBytes(&seed_salt_, sizeof(seed_salt_));
+        hash = HashBytes(q_init.data.data(), q_init.data.size() * sizeof(double), hash);
+        for (const Tip& tip : tips_) {
+            hash = HashQuery(KDL::JntArray(), tip.target, tip.bounds, hash);
+        }
+        hash = HashBytes(joint_min_.data.data(), joint_min_.data.size() * sizeof(double), hash);
+        hash = HashBytes(joint_max_.data.data(), joint_max_.data.size() * sizeof(double), hash);
+
+        std::seed_seq seq{ uint32_t(hash), uint32_t(hash >> 32) };
+        rng_.seed(seq);
+    }
+
+    q_curr_ = q_init;
+    updateKinematics(q_curr_);
+
+    // restart when clamping at the joint limits stalls the descent
+    const int max_stalled = 20;
+    double best_err = std::numeric_limits<double>::infinity();
+    int stalled = 0;
+
+    for (int i = 0; i < max_iters_; ++i) {
+        if (converged()) {
+            if (!filter || filter(q_curr_)) {
+                q_out = q_curr_;
+                iterations_ = i;
+                return 0;
+            }
+            ROS_DEBUG_NAMED("deterministic_trac_ik", "Tree solution rejected by filter on iteration %d", i);
+            randomize(q_curr_);
+            updateKinematics(q_curr_);
+            best_err = std::numeric_limits<double>::infinity();
+            stalled = 0;
+            continue;
+        }
+
+        updateTask();
+
+        const double err = err_.norm();
+        if (err < 0.99 * best_err) {
+            best_err = err;
+            stalled = 0;
+        } else if (++stalled >= max_stalled) {
+            randomize(q_curr_);
+            updateKinematics(q_curr_);
+            best_err = std::numeric_limits<double>::infinity();
+            stalled = 0;
+            continue;
+        }
+
+        solveVelocity();
+
+        // clamp to the joint limits, as KDL does
+        for (size_t j = 0; j < chain_types_.size(); ++j) {
+            q_next_(j) = q_curr_(j) + delta_q_(j);
+            if (joint_types_[j] == KDL::BasicJointType::Continuous) {
+                continue;
+            }
+            q_next_(j) = std::max(joint_min_(j), std::min(joint_max_(j), q_next_(j)));
+        }
+
+        KDL::Subtract(q_curr_, q_next_, q_curr_);
+        if (q_curr_.data.isZero(boost::math::tools::epsilon<float>())) {
+            randomize(q_next_);
+            best_err = std::numeric_limits<double>::infinity();
+            stalled = 0;
+        }
+
+        std::swap(q_curr_, q_next_);
+        updateKinematics(q_curr_);
+    }
+    iterations_ = std::max(0, max_iters_);
+
+    if (converged() && (!filter || filter(q_curr_))) {
+        q_out = q_curr_;
+        return 0;
+    }
+
+    ROS_DEBUG_NAMED("deterministic_trac_ik", "Tree solver failed to find solution");
+    return NoSolution;
+}
+
+void TreeIkSolver::JntToCart(const KDL::JntArray& q, std::vector<KDL::Frame>& p_out)
+{
+    updateKinematics(q);
+    p_out.resize(tips_.size());
+    for (size_t k = 0; k < tips_.size(); ++k) {
+        p_out[k] = frames_[tips_[k].segment];
+    }
+}
+
+int TreeIkSolver::JntToCart(
+    const KDL::JntArray& q,
+    const std::string& name,
+    KDL::Frame& p_out)
+{
+    const int index = findSegment(name);
+    if (index < 0) {
+        return -1;
+    }
+
+    updateKinematics(q);
+    p_out = frames_[index];
+    return 0;
+}
+
+int TreeIkSolver::findSegment(const std::string& name) const
+{
+    for (size_t s = 0; s < segments_.size(); ++s) {
+        if (segments_[s].segment.getName() == name) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+void TreeIkSolver::updateKinematics(const KDL::JntArray& q)
+{
+    for (size_t s = 0; s < segments_.size(); ++s) {
+        const TreeSegment& tree_segment = segments_[s];
+        const KDL::Frame& parent = tree_segment.parent < 0 ?
+                KDL::Frame::Identity() : frames_[tree_segment.parent];
+
+        if (tree_segment.joint < 0) {
+            frames_[s] = parent * tree_segment.segment.pose(0.0);
+            continue;
+        }
+
+        const double q_j = q(tree_segment.joint);
+        twists_[s] = parent.M * tree_segment.segment.twist(q_j, 1.0);
+        frames_[s] = parent * tree_segment.segment.pose(q_j);
+    }
+}
+
+void TreeIkSolver::updateTask()
+{
+    jac_.setZero();
+
+    int row = 0;
+    for (const Tip& tip : tips_) {
+        const KDL::Frame& f_tip = frames_[tip.segment];
+        const KDL::Twist delta_twist = KDL::diff(f_tip, tip.target);
+
+        // as in ChainIkSolverPos_TL, constrained axes are expressed in the
+        // frame of the target when some of them are free
+        const KDL::Rotation r = tip.free_axes == 0 ?
+                KDL::Rotation::Identity() : tip.target.M.Inverse();
+        const KDL::Twist e(r * delta_twist.vel, r * delta_twist.rot);
+
+        for (int i : tip.rows) {
+            err_(row) = e[i];
+            for (int s : tip.joint_segments) {
+                const KDL::Twist& t = twists_[s];
+                const KDL::Twist column(
+                        r * t.RefPoint(f_tip.p - frames_[s].p).vel,
+                        r * t.rot);
+                jac_(row, segments_[s].joint) = column[i];
+            }
+            ++row;
+        }
+    }
+}
+
+bool TreeIkSolver::converged() const
+{
+    for (const Tip& tip : tips_) {
+        KDL::Twist delta_twist = KDL::diffRelativeFree(tip.target, frames_[tip.segment], tip.free_axes);
+        for (int i = 0; i < 6; ++i) {
+            if (std::abs(delta_twist[i]) <= std::abs(tip.bounds[i])) {
+                delta_twist[i] = 0.0;
+            }
+        }
+        if (!KDL::Equal(delta_twist, KDL::Twist::Zero(), eps_)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TreeIkSolver::solveVelocity()
+{
+    // damped least squares in the smaller of the task and joint spaces; the
+    // eigenvalues of the Gram matrix are the squared singular values
+    const bool task_space = jac_.rows() <= jac_.cols();
+    if (task_space) {
+        gram_.noalias() = jac_ * jac_.transpose();
+    } else {
+        gram_.noalias() = jac_.transpose() * jac_;
+    }
+
+    if (damping_.max_damping > 0.0) {
+        double sigma = 0.0;
+        if (gram_.rows() > 0) {
+            eig_.compute(gram_, Eigen::EigenvaluesOnly);
+            sigma = std::sqrt(std::max(0.0, eig_.eigenvalues()(0)));
+        }
+        gram_.diagonal().array() += damping_.squared(sigma);
+    }
+
+    ldlt_.compute(gram_);
+
+    if (task_space) {
+        tmp_ = ldlt_.solve(err_);
+        delta_q_.noalias() = jac_.transpose() * tmp_;
+    } else {
+        tmp_.noalias() = jac_.transpose() * err_;
+        delta_q_ = ldlt_.solve(tmp_);
+    }
+}
+
+void TreeIkSolver::randomize(KDL::JntArray& q)
+{
+    for (size_t j = 0; j < q.rows(); ++j) {
+        if (joint_types_[j] == KDL::BasicJointType::Continuous) {
+            std::uniform_real_distribution<double> dist(
+                    q(j) - 2.0 * M_PI, q(j) + 2.0 * M_PI);
+            q(j) = dist(rng_);
+        } else {
+            std::uniform_real_distribution<double> dist(
+                    joint_min_(j), joint_max_(j));
+            q(j) = dist(rng_);
+        }
+    }
+}
+
+} // namespace Deterministic_TRAC_IK
@@ -1,9 +1,18 @@
 #include <deterministic_trac_ik/utils.h>
 
 #include <assert.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
 
+#include <fcntl.h>
 #include <kdl/tree.hpp>
 #include <kdl_parser/kdl_parser.hpp>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace Deterministic_TRAC_IK {
 
@@ -35,11 +44,79 @@ bool LoadModelOverride(
         return false;
     }
 
-    nh.param(full_urdf_xml, xml_string, std::string());
     model.initString(xml_string);
     return true;
 }
 
+// Return the limits of a movable joint, narrowed to its soft limits if it
+// has a safety controller. Continuous joints are given float limits.
+static void GetJointLimits(const urdf::Joint& joint, double& joint_min, double& joint_max)
+{
+    if (joint.type == urdf::Joint::CONTINUOUS) {
+        joint_min = std::numeric_limits<float>::lowest();
+        joint_max = std::numeric_limits<float>::max();
+        return;
+    }
+
+    float lower, upper;
+    if (joint.safety) {
+        lower = std::max(joint.limits->lower, joint.safety->soft_lower_limit);
+        upper = std::min(joint.limits->upper, joint.safety->soft_upper_limit);
+    } else {
+        lower = joint.limits->lower;
+        upper = joint.limits->upper;
+    }
+    joint_min = lower;
+    joint_max = upper;
+}
+
+// Trees and chains extracted from robot descriptions, shared by every solver
+// in the process. MoveIt creates a plugin instance per group, and sometimes
+// per thread, all of them for the same robot.
+namespace {
+
+struct ExtractedChain
+{
+    KDL::Chain chain;
+    std::vector<std::string> link_names;
+    std::vector<std::string> joint_names;
+    KDL::JntArray joint_min;
+    KDL::JntArray joint_max;
+};
+
+std::mutex extraction_mutex;
+std::map<uint64_t, std::shared_ptr<const KDL::Tree>> tree_cache;
+std::map<std::pair<uint64_t, std::string>, ExtractedChain> chain_cache;
+
+// must be called with extraction_mutex held
+std::shared_ptr<const KDL::Tree> GetKDLTreeLocked(
+    const urdf::ModelInterface& model,
+    uint64_t signature)
+{
+    auto it = tree_cache.find(signature);
+    if (it != tree_cache.end()) {
+        return it->second;
+    }
+
+    std::shared_ptr<KDL::Tree> tree = std::make_shared<KDL::Tree>();
+    if (!kdl_parser::treeFromUrdfModel(model, *tree)) {
+        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to extract kdl tree from xml robot description");
+        return std::shared_ptr<const KDL::Tree>();
+    }
+
+    tree_cache[signature] = tree;
+    return tree;
+}
+
+} // namespace
+
+std::shared_ptr<const KDL::Tree> GetKDLTree(const urdf::ModelInterface& model)
+{
+    const uint64_t signature = ModelSignature(model);
+    std::lock_guard<std::mutex> lock(extraction_mutex);
+    return GetKDLTreeLocked(model, signature);
+}
+
 bool InitKDLChain(
     const urdf::ModelInterface& model,
     const std::string& base_name,
@@ -50,59 +127,196 @@ bool InitKDLChain(
     KDL::JntArray& joint_min,
     KDL::JntArray& joint_max)
 {
-    KDL::Tree tree;
+    const uint64_t signature = ModelSignature(model);
+    const auto key = std::make_pair(signature, base_name + '\n' + tip_name);
 
-    if (!kdl_parser::treeFromUrdfModel(model, tree)) {
-        ROS_ERROR_NAMED("deterministic_trac_ik", "Failed to extract kdl tree from xml robot description");
-        return false;
+    std::lock_guard<std::mutex> lock(extraction_mutex);
+
+    auto it = chain_cache.find(key);
+    if (it == chain_cache.end()) {
+        std::shared_ptr<const KDL::Tree> tree = GetKDLTreeLocked(model, signature);
+        if (!tree) {
+            return false;
+        }
+
+        ExtractedChain extracted;
+        if (!tree->getChain(base_name, tip_name, extracted.chain)) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Couldn't find chain %s to %s", base_name.c_str(), tip_name.c_str());
+            return false;
+        }
+
+        extracted.joint_min.resize(extracted.chain.getNrOfJoints());
+        extracted.joint_max.resize(extracted.chain.getNrOfJoints());
+
+        unsigned int joint_num = 0;
+        for (auto& segment : extracted.chain.segments) {
+            extracted.link_names.push_back(segment.getName());
+            auto joint = model.getJoint(segment.getJoint().getName());
+            if (joint->type != urdf::Joint::UNKNOWN &&
+                joint->type != urdf::Joint::FIXED)
+            {
+                joint_num++;
+                assert(joint_num <= extracted.chain.getNrOfJoints());
+                extracted.joint_names.push_back(joint->name);
+                GetJointLimits(*joint, extracted.joint_min(joint_num - 1), extracted.joint_max(joint_num - 1));
+                ROS_DEBUG_STREAM("IK Using joint " << segment.getName() << " " << extracted.joint_min(joint_num - 1) << " " << extracted.joint_max(joint_num - 1));
+            }
+        }
+
+        it = chain_cache.insert(std::make_pair(key, extracted)).first;
+    }
+    else {
+        ROS_DEBUG_NAMED("deterministic_trac_ik", "Reusing chain %s to %s", base_name.c_str(), tip_name.c_str());
     }
 
-    if (!tree.getChain(base_name, tip_name, chain)) {
-        ROS_ERROR_NAMED("deterministic_trac_ik", "Couldn't find chain %s to %s", base_name.c_str(), tip_name.c_str());
+    const ExtractedChain& extracted = it->second;
+    chain = extracted.chain;
+    link_names.insert(link_names.end(), extracted.link_names.begin(), extracted.link_names.end());
+    joint_names.insert(joint_names.end(), extracted.joint_names.begin(), extracted.joint_names.end());
+    joint_min = extracted.joint_min;
+    joint_max = extracted.joint_max;
+    return true;
+}
+
+bool InitKDLTree(
+    const urdf::ModelInterface& model,
+    const std::string& base_name,
+    const std::vector<std::string>& tip_names,
+    KDL::Tree& tree,
+    std::vector<std::string>& link_names,
+    std::vector<std::string>& joint_names,
+    KDL::JntArray& joint_min,
+    KDL::JntArray& joint_max)
+{
+    std::shared_ptr<const KDL::Tree> parsed = GetKDLTree(model);
+    if (!parsed) {
         return false;
     }
+    tree = *parsed;
 
-    joint_min.resize(chain.getNrOfJoints());
-    joint_max.resize(chain.getNrOfJoints());
+    std::vector<double> lower, upper;
+    for (const std::string& tip_name : tip_names) {
+        KDL::Chain chain;
+        if (!tree.getChain(base_name, tip_name, chain)) {
+            ROS_ERROR_NAMED("deterministic_trac_ik", "Couldn't find chain %s to %s", base_name.c_str(), tip_name.c_str());
+            return false;
+        }
 
-    unsigned int joint_num = 0;
-    for (auto& segment : chain.segments) {
-        link_names.push_back(segment.getName());
-        auto joint = model.getJoint(segment.getJoint().getName());
-        if (joint->type != urdf::Joint::UNKNOWN &&
-            joint->type != urdf::Joint::FIXED)
-        {
-            joint_num++;
-            assert(joint_num <= chain.getNrOfJoints());
-            float lower, upper;
-            int hasLimits;
-            joint_names.push_back(joint->name);
-            if (joint->type != urdf::Joint::CONTINUOUS) {
-                if (joint->safety) {
-                    lower = std::max(joint->limits->lower, joint->safety->soft_lower_limit);
-                    upper = std::min(joint->limits->upper, joint->safety->soft_upper_limit);
-                } else {
-                    lower = joint->limits->lower;
-                    upper = joint->limits->upper;
-                }
-                hasLimits = 1;
-            } else {
-                hasLimits = 0;
+        for (auto& segment : chain.segments) {
+            if (std::find(link_names.begin(), link_names.end(), segment.getName()) != link_names.end()) {
+                continue; // shared with the chain to a previous tip
             }
-            if (hasLimits) {
-                joint_min(joint_num - 1) = lower;
-                joint_max(joint_num - 1) = upper;
-            } else {
-                joint_min(joint_num - 1) = std::numeric_limits<float>::lowest();
-                joint_max(joint_num - 1) = std::numeric_limits<float>::max();
+            link_names.push_back(segment.getName());
+
+            auto joint = model.getJoint(segment.getJoint().getName());
+            if (joint->type != urdf::Joint::UNKNOWN &&
+                joint->type != urdf::Joint::FIXED)
+            {
+                joint_names.push_back(joint->name);
+                lower.push_back(0.0);
+                upper.push_back(0.0);
+                GetJointLimits(*joint, lower.back(), upper.back());
+                ROS_DEBUG_STREAM("IK Using joint " << segment.getName() << " " << lower.back() << " " << upper.back());
             }
-            ROS_DEBUG_STREAM("IK Using joint " << segment.getName() << " " << joint_min(joint_num - 1) << " " << joint_max(joint_num - 1));
         }
     }
 
+    joint_min.resize(lower.size());
+    joint_max.resize(upper.size());
+    for (size_t j = 0; j < lower.size(); ++j) {
+        joint_min(j) = lower[j];
+        joint_max(j) = upper[j];
+    }
+
     return true;
 }
 
+int OpenLocked(const std::string& path)
+{
+    for (;;) {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+
+        struct stat locked;
+        struct stat current;
+        if (flock(fd, LOCK_EX) != 0 || fstat(fd, &locked) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        if (stat(path.c_str(), &current) == 0 &&
+            current.st_dev == locked.st_dev &&
+            current.st_ino == locked.st_ino)
+        {
+            return fd;
+        }
+        ::close(fd);
+    }
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t HashQuery(
+    const KDL::JntArray& q_init,
+    const KDL::Frame& p_in,
+    const KDL::Twist& bounds,
+    uint64_t hash)
+{
+    hash = HashBytes(q_init.data.data(), q_init.data.size() * sizeof(double), hash);
+    hash = HashBytes(p_in.p.data, sizeof(p_in.p.data), hash);
+    hash = HashBytes(p_in.M.data, sizeof(p_in.M.data), hash);
+    hash = HashBytes(bounds.vel.data, sizeof(bounds.vel.data), hash);
+    hash = HashBytes(bounds.rot.data, sizeof(bounds.rot.data), hash);
+    return hash;
+}
+
+static uint64_t HashString(const std::string& s, uint64_t hash)
+{
+    // hash the terminator too, so that consecutive strings cannot alias
+    return HashBytes(s.c_str(), s.size() + 1, hash);
+}
+
+uint64_t ModelSignature(const urdf::ModelInterface& model)
+{
+    uint64_t hash = HashBytes(nullptr, 0);
+    for (const auto& entry : model.joints_) {
+        const urdf::Joint& joint = *entry.second;
+        hash = HashString(joint.name, hash);
+        hash = HashString(joint.parent_link_name, hash);
+        hash = HashString(joint.child_link_name, hash);
+
+        // also tell whether the joint has limits and a safety controller
+        const int32_t type = joint.type | (joint.limits ? 0x100 : 0) | (joint.safety ? 0x200 : 0);
+        const urdf::Pose& origin = joint.parent_to_joint_origin_transform;
+        const double values[] = {
+            origin.position.x, origin.position.y, origin.position.z,
+            origin.rotation.x, origin.rotation.y, origin.rotation.z, origin.rotation.w,
+            joint.axis.x, joint.axis.y, joint.axis.z,
+        };
+        hash = HashBytes(&type, sizeof(type), hash);
+        hash = HashBytes(values, sizeof(values), hash);
+
+        if (joint.limits) {
+            const double limits[] = { joint.limits->lower, joint.limits->upper };
+            hash = HashBytes(limits, sizeof(limits), hash);
+        }
+        if (joint.safety) {
+            const double safety[] = { joint.safety->soft_lower_limit, joint.safety->soft_upper_limit };
+            hash = HashBytes(safety, sizeof(safety), hash);
+        }
+    }
+    return hash;
+}
+
 } // namespace Deterministic_TRAC_IK
 
 namespace KDL {
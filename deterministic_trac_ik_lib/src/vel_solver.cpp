@@ -0,0 +1,170 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#include <deterministic_trac_ik/vel_solver.hpp>
+
+// standard includes
+#include <algorithm>
+#include <cmath>
+
+namespace KDL {
+
+template <typename Scalar>
+PinvVelSolverT<Scalar>::PinvVelSolverT(unsigned int nj)
+:
+    svd_(6, nj, Eigen::ComputeThinU | Eigen::ComputeThinV),
+    tmp_()
+{
+}
+
+template <typename Scalar>
+void PinvVelSolverT<Scalar>::solve(
+    const TaskJacobianT<Scalar>& jac,
+    const TaskVectorT<Scalar>& v,
+    JointVector& qdot)
+{
+    // singular values this small are treated as exactly zero, as in
+    // KDL::ChainIkSolverVel_pinv
+    const Scalar eps = Scalar(1e-5);
+
+    svd_.compute(jac);
+
+    const auto& sigma = svd_.singularValues();
+    const Scalar lambda_sq = Scalar(this->damping_.squared(sigma.size() > 0 ? sigma(sigma.size() - 1) : 0.0));
+
+    tmp_.noalias() = svd_.matrixU().transpose() * v;
+    for (int i = 0; i < sigma.size(); ++i) {
+        if (sigma(i) < eps) {
+            tmp_(i) = Scalar(0);
+        } else {
+            tmp_(i) *= sigma(i) / (sigma(i) * sigma(i) + lambda_sq);
+        }
+    }
+
+    qdot.noalias() = svd_.matrixV() * tmp_;
+}
+
+template <typename Scalar>
+DLSVelSolverT<Scalar>::DLSVelSolverT(unsigned int nj)
+:
+    jjt_(),
+    ldlt_(6),
+    eig_(6),
+    tmp_()
+{
+    this->damping_ = DefaultDamping(VelSolverDLS);
+}
+
+template <typename Scalar>
+void DLSVelSolverT<Scalar>::solve(
+    const TaskJacobianT<Scalar>& jac,
+    const TaskVectorT<Scalar>& v,
+    JointVector& qdot)
+{
+    jjt_.noalias() = jac * jac.transpose();
+
+    // the eigenvalues of J J^T are the squared singular values of J; the
+    // pivots of its LDLT are not, and overestimate the smallest one
+    Scalar lambda_sq(0);
+    if (this->damping_.max_damping > 0.0) {
+        eig_.compute(jjt_, Eigen::EigenvaluesOnly);
+        const double sigma = std::sqrt(std::max(0.0, (double)eig_.eigenvalues()(0)));
+        lambda_sq = Scalar(this->damping_.squared(sigma));
+        jjt_.diagonal().array() += lambda_sq;
+    }
+
+    ldlt_.compute(jjt_);
+
+    tmp_ = ldlt_.solve(v);
+    qdot.noalias() = jac.transpose() * tmp_;
+}
+
+template <typename Scalar>
+TransposeVelSolverT<Scalar>::TransposeVelSolverT(unsigned int nj)
+:
+    jjtv_()
+{
+    this->damping_ = DefaultDamping(VelSolverTranspose);
+}
+
+template <typename Scalar>
+void TransposeVelSolverT<Scalar>::solve(
+    const TaskJacobianT<Scalar>& jac,
+    const TaskVectorT<Scalar>& v,
+    JointVector& qdot)
+{
+    qdot.noalias() = jac.transpose() * v;
+    jjtv_.noalias() = jac * qdot;
+
+    const Scalar v_norm = v.norm();
+    if (v_norm == Scalar(0)) {
+        qdot.setZero();
+        return;
+    }
+
+    // gain of J J^T along the error direction; small near a singularity
+    // that the error cannot escape
+    const double sigma = std::sqrt((double)(jjtv_.norm() / v_norm));
+    const Scalar lambda_sq = Scalar(this->damping_.squared(sigma));
+
+    const Scalar denom = jjtv_.squaredNorm() + lambda_sq;
+    if (denom == Scalar(0)) {
+        qdot.setZero();
+        return;
+    }
+
+    qdot *= v.dot(jjtv_) / denom;
+}
+
+template <typename Scalar>
+std::unique_ptr<VelSolverT<Scalar>> MakeVelSolverT(VelSolverType type, unsigned int nj)
+{
+    switch (type) {
+    case VelSolverDLS:
+        return std::unique_ptr<VelSolverT<Scalar>>(new DLSVelSolverT<Scalar>(nj));
+    case VelSolverTranspose:
+        return std::unique_ptr<VelSolverT<Scalar>>(new TransposeVelSolverT<Scalar>(nj));
+    case VelSolverPinv:
+    default:
+        return std::unique_ptr<VelSolverT<Scalar>>(new PinvVelSolverT<Scalar>(nj));
+    }
+}
+
+template class PinvVelSolverT<float>;
+template class PinvVelSolverT<double>;
+template class DLSVelSolverT<float>;
+template class DLSVelSolverT<double>;
+template class TransposeVelSolverT<float>;
+template class TransposeVelSolverT<double>;
+
+template std::unique_ptr<VelSolverT<float>> MakeVelSolverT<float>(VelSolverType, unsigned int);
+template std::unique_ptr<VelSolverT<double>> MakeVelSolverT<double>(VelSolverType, unsigned int);
+
+} // namespace KDL
@@ -0,0 +1,103 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+#ifndef DETERMINISTIC_TRAC_IK_TEST_CHAINS_HPP
+#define DETERMINISTIC_TRAC_IK_TEST_CHAINS_HPP
+
+// standard includes
+#include <random>
+#include <string>
+
+// system includes
+#include <kdl/chain.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+
+namespace Deterministic_TRAC_IK {
+
+/// Build an arm of \p num_joints revolute joints alternating between the z
+/// and y axes, 0.3 m apart, with a fixed, rotated segment after the third
+/// joint, and limits of +-2.5 rad.
+inline KDL::Chain MakeArm(
+    unsigned int num_joints,
+    KDL::JntArray& q_min,
+    KDL::JntArray& q_max)
+{
+    KDL::Chain chain;
+    for (unsigned int i = 0; i < num_joints; ++i) {
+        const KDL::Vector axis = i % 2 == 0 ? KDL::Vector(0, 0, 1) : KDL::Vector(0, 1, 0);
+        chain.addSegment(KDL::Segment(
+                "link" + std::to_string(i),
+                KDL::Joint("joint" + std::to_string(i), KDL::Vector::Zero(), axis, KDL::Joint::RotAxis),
+                KDL::Frame(KDL::Vector(0.0, 0.0, 0.3))));
+        if (i == 2) {
+            chain.addSegment(KDL::Segment(
+                    "fixed",
+                    KDL::Joint("fixed_joint", KDL::Joint::None),
+                    KDL::Frame(KDL::Rotation::RotX(0.3), KDL::Vector(0.05, 0.0, 0.0))));
+        }
+    }
+
+    q_min.resize(num_joints);
+    q_max.resize(num_joints);
+    for (unsigned int i = 0; i < num_joints; ++i) {
+        q_min(i) = -2.5;
+        q_max(i) = 2.5;
+    }
+    return chain;
+}
+
+/// Return a configuration drawn uniformly from [q_min + margin, q_max - margin].
+inline KDL::JntArray RandomConfiguration(
+    std::default_random_engine& rng,
+    const KDL::JntArray& q_min,
+    const KDL::JntArray& q_max,
+    double margin = 0.0)
+{
+    KDL::JntArray q(q_min.rows());
+    for (unsigned int j = 0; j < q.rows(); ++j) {
+        std::uniform_real_distribution<double> dist(q_min(j) + margin, q_max(j) - margin);
+        q(j) = dist(rng);
+    }
+    return q;
+}
+
+inline KDL::Frame TipFrame(const KDL::Chain& chain, const KDL::JntArray& q)
+{
+    KDL::ChainFkSolverPos_recursive fk(chain);
+    KDL::Frame p;
+    fk.JntToCart(q, p);
+    return p;
+}
+
+} // namespace Deterministic_TRAC_IK
+
+#endif
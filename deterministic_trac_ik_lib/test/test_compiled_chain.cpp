@@ -0,0 +1,152 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+// standard includes
+#include <random>
+#include <string>
+#include <vector>
+
+// system includes
+#include <gtest/gtest.h>
+
+// project includes
+#include <deterministic_trac_ik/compiled_chain.hpp>
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include "test_chains.hpp"
+#include "test_files.hpp"
+
+namespace Deterministic_TRAC_IK {
+
+class CompiledChainTest : public ::testing::Test
+{
+protected:
+
+    CompiledChainTest() :
+        chain(MakeArm(6, q_min, q_max))
+    {
+        for (unsigned int i = 0; i < chain.getNrOfSegments(); ++i) {
+            const KDL::Joint& joint = chain.getSegment(i).getJoint();
+            if (joint.getType() != KDL::Joint::None) {
+                joint_names.push_back(joint.getName());
+            }
+        }
+    }
+
+    KDL::JntArray q_min;
+    KDL::JntArray q_max;
+    KDL::Chain chain;
+    std::vector<std::string> joint_names;
+
+    static const uint64_t SourceKey = 42;
+};
+
+TEST_F(CompiledChainTest, FusesFixedSegments)
+{
+    KDL::Chain with_base;
+    with_base.addSegment(KDL::Segment("base", KDL::Joint("base_joint", KDL::Joint::None), KDL::Frame(KDL::Vector(0.0, 0.0, 0.1))));
+    with_base.addSegment(KDL::Segment("mount", KDL::Joint("mount_joint", KDL::Joint::None), KDL::Frame(KDL::Rotation::RotZ(0.5))));
+    with_base.addChain(chain);
+
+    const KDL::Chain fused = FuseFixedSegments(with_base);
+    ASSERT_EQ(chain.getNrOfJoints(), fused.getNrOfJoints());
+
+    // one leading fixed segment, named after the last of its run, and one
+    // segment per joint
+    ASSERT_EQ(chain.getNrOfJoints() + 1, fused.getNrOfSegments());
+    EXPECT_EQ(KDL::Joint::None, fused.getSegment(0).getJoint().getType());
+    EXPECT_EQ("mount", fused.getSegment(0).getName());
+
+    std::default_random_engine rng(11);
+    for (int i = 0; i < 10; ++i) {
+        const KDL::JntArray q = RandomConfiguration(rng, q_min, q_max);
+        EXPECT_TRUE(KDL::Equal(TipFrame(with_base, q), TipFrame(fused, q), 1e-12)) << i;
+    }
+}
+
+TEST_F(CompiledChainTest, LoadsTheChainItBuilt)
+{
+    TempFile file("compiled_chain");
+    const CompiledChain compiled(chain, joint_names, q_min, q_max);
+    ASSERT_TRUE(compiled.valid());
+    ASSERT_TRUE(compiled.save(file.path(), SourceKey));
+
+    CompiledChain loaded;
+    ASSERT_TRUE(loaded.load(file.path(), SourceKey));
+    EXPECT_EQ(compiled.linkNames(), loaded.linkNames());
+    EXPECT_EQ(joint_names, loaded.jointNames());
+    EXPECT_EQ(q_min.data, loaded.lowerLimits().data);
+    EXPECT_EQ(q_max.data, loaded.upperLimits().data);
+    EXPECT_EQ(compiled.jointTypes(), loaded.jointTypes());
+
+    // the loaded chain is identical to the one built, not just close, so
+    // solvers give the same answers on both
+    Deterministic_TRAC_IK built_ik(compiled.chain(), q_min, q_max, 1000, 1e-5, Distance);
+    Deterministic_TRAC_IK loaded_ik(loaded.chain(), q_min, q_max, 1000, 1e-5, Distance);
+    std::default_random_engine rng(12);
+    for (int i = 0; i < 5; ++i) {
+        const KDL::JntArray target = RandomConfiguration(rng, q_min, q_max);
+        EXPECT_TRUE(KDL::Equal(TipFrame(chain, target), TipFrame(loaded.chain(), target), 1e-12));
+
+        const KDL::Frame p_in = TipFrame(compiled.chain(), target);
+        const KDL::JntArray seed(6);
+        KDL::JntArray q_built, q_loaded;
+        EXPECT_EQ(built_ik.CartToJnt(seed, p_in, q_built), loaded_ik.CartToJnt(seed, p_in, q_loaded));
+        EXPECT_EQ(q_built.data, q_loaded.data) << i;
+    }
+}
+
+TEST_F(CompiledChainTest, RejectsStaleAndDamagedFiles)
+{
+    TempFile file("compiled_chain");
+    const CompiledChain compiled(chain, joint_names, q_min, q_max);
+    ASSERT_TRUE(compiled.save(file.path(), SourceKey));
+
+    // a file written for another robot description
+    CompiledChain stale;
+    EXPECT_FALSE(stale.load(file.path(), SourceKey + 1));
+    EXPECT_FALSE(stale.valid());
+
+    const std::string data = ReadFile(file.path());
+    WriteFile(file.path(), data.substr(0, data.size() - 1));
+    CompiledChain truncated;
+    EXPECT_FALSE(truncated.load(file.path(), SourceKey));
+    EXPECT_FALSE(truncated.valid());
+
+    CompiledChain missing;
+    EXPECT_FALSE(missing.load(file.path() + ".missing", SourceKey));
+}
+
+} // namespace Deterministic_TRAC_IK
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,347 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+// standard includes
+#include <cmath>
+#include <random>
+#include <vector>
+
+// system includes
+#include <gtest/gtest.h>
+
+// project includes
+#include <deterministic_trac_ik/cost_model.hpp>
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/restart_policy.hpp>
+#include "test_chains.hpp"
+
+namespace Deterministic_TRAC_IK {
+
+TEST(ConsistencyLimits, SolutionsStayWithinTheWindow)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+
+    KDL::JntArray limits(6);
+    for (unsigned int j = 0; j < 6; ++j) {
+        limits(j) = 0.3;
+    }
+
+    std::default_random_engine rng(1);
+    std::uniform_real_distribution<double> offset(-0.05, 0.05);
+    for (SolveType type : { Speed, Distance }) {
+        Deterministic_TRAC_IK ik(chain, q_min, q_max, 5000, 1e-5, type);
+        for (int i = 0; i < 10; ++i) {
+            const KDL::JntArray seed = RandomConfiguration(rng, q_min, q_max, 0.5);
+            KDL::JntArray target = seed;
+            for (unsigned int j = 0; j < 6; ++j) {
+                target(j) += offset(rng);
+            }
+
+            KDL::JntArray q;
+            ASSERT_GE(ik.CartToJnt(seed, TipFrame(chain, target), q, KDL::Twist::Zero(), limits), 0) << type << " " << i;
+            for (unsigned int j = 0; j < 6; ++j) {
+                EXPECT_LE(std::abs(q(j) - seed(j)), limits(j)) << "joint " << j;
+            }
+        }
+    }
+}
+
+TEST(ConsistencyLimits, WindowOutsideTheJointLimitsFails)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 5000, 1e-5, Speed);
+
+    // the window of the first joint, [2.9, 3.1], misses its limits
+    KDL::JntArray seed(6);
+    seed(0) = 3.0;
+    KDL::JntArray limits(6);
+    for (unsigned int j = 0; j < 6; ++j) {
+        limits(j) = 0.1;
+    }
+
+    KDL::JntArray q;
+    EXPECT_LT(ik.CartToJnt(seed, TipFrame(chain, seed), q, KDL::Twist::Zero(), limits), 0);
+}
+
+TEST(SolutionFilter, RejectedCandidatesAreNotReturned)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 5000, 1e-5, Speed);
+
+    std::default_random_engine rng(2);
+    const KDL::JntArray target = RandomConfiguration(rng, q_min, q_max, 0.5);
+    const KDL::Frame p_in = TipFrame(chain, target);
+
+    // reject the first candidate; the search has to find another one
+    std::vector<KDL::JntArray> candidates;
+    SolutionFilter filter = [&](const KDL::JntArray& q) {
+        candidates.push_back(q);
+        return candidates.size() > 1;
+    };
+
+    KDL::JntArray seed(6);
+    KDL::JntArray q;
+    ASSERT_GE(ik.CartToJnt(seed, p_in, q, KDL::Twist::Zero(), KDL::JntArray(), filter), 0);
+    ASSERT_GE(candidates.size(), 2u);
+    EXPECT_TRUE(q.data.isApprox(candidates.back().data));
+    EXPECT_FALSE(q.data.isApprox(candidates.front().data, 1e-3));
+    EXPECT_TRUE(KDL::Equal(TipFrame(chain, q), p_in, 1e-4));
+}
+
+TEST(SolutionFilter, RejectingEverythingFails)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 500, 1e-5, Speed);
+
+    std::default_random_engine rng(3);
+    const KDL::JntArray target = RandomConfiguration(rng, q_min, q_max, 0.5);
+
+    int calls = 0;
+    SolutionFilter filter = [&](const KDL::JntArray&) {
+        ++calls;
+        return false;
+    };
+
+    KDL::JntArray seed(6);
+    KDL::JntArray q;
+    EXPECT_LT(ik.CartToJnt(seed, TipFrame(chain, target), q, KDL::Twist::Zero(), KDL::JntArray(), filter), 0);
+    EXPECT_GT(calls, 0);
+}
+
+TEST(StagnationPolicy, AbandonsUnreachableTargets)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 20000, 1e-5, Speed);
+
+    // the arm is less than 2 m long
+    const KDL::Frame p_in(KDL::Vector(3.0, 0.0, 0.0));
+    const KDL::JntArray seed(6);
+    KDL::JntArray q;
+    EXPECT_EQ(NoSolution, ik.CartToJnt(seed, p_in, q));
+
+    StagnationPolicy policy;
+    policy.patience = 5;
+    ik.setStagnationPolicy(policy);
+    EXPECT_EQ(Stagnated, ik.CartToJnt(seed, p_in, q));
+
+    // searches that keep approaching their targets are not cut short
+    Deterministic_TRAC_IK plain(chain, q_min, q_max, 20000, 1e-5, Speed);
+    Deterministic_TRAC_IK patient(chain, q_min, q_max, 20000, 1e-5, Speed);
+    patient.setStagnationPolicy(policy);
+    std::default_random_engine rng(9);
+    int solved = 0;
+    for (int i = 0; i < 10; ++i) {
+        const KDL::Frame reachable = TipFrame(chain, RandomConfiguration(rng, q_min, q_max, 0.5));
+        KDL::JntArray q_plain;
+        const int rc = plain.CartToJnt(seed, reachable, q_plain);
+        ASSERT_EQ(rc, patient.CartToJnt(seed, reachable, q)) << i;
+        if (rc >= 0) {
+            EXPECT_EQ(q_plain.data, q.data) << i;
+            ++solved;
+        }
+    }
+    EXPECT_GE(solved, 8);
+}
+
+TEST(PerQuerySeeding, ResultsDependOnlyOnTheQuery)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+
+    std::default_random_engine rng(10);
+    std::vector<KDL::Frame> targets;
+    for (int i = 0; i < 5; ++i) {
+        targets.push_back(TipFrame(chain, RandomConfiguration(rng, q_min, q_max)));
+    }
+    const KDL::JntArray seed(6);
+
+    for (SolveType type : { Speed, Distance }) {
+        // the first solver handles the other queries before the last one
+        Deterministic_TRAC_IK warm(chain, q_min, q_max, 1000, 1e-5, type);
+        warm.setPerQuerySeeding(true);
+        KDL::JntArray q_warm;
+        int rc_warm = 0;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            rc_warm = warm.CartToJnt(seed, targets[i], q_warm);
+        }
+
+        Deterministic_TRAC_IK fresh(chain, q_min, q_max, 1000, 1e-5, type);
+        fresh.setPerQuerySeeding(true);
+        KDL::JntArray q_fresh;
+        const int rc_fresh = fresh.CartToJnt(seed, targets.back(), q_fresh);
+
+        EXPECT_EQ(rc_fresh, rc_warm) << type;
+        EXPECT_EQ(q_fresh.data, q_warm.data) << type;
+    }
+}
+
+TEST(RestartPolicy, MonitorEndsAttemptsOnPlateausAndStepLimits)
+{
+    RestartPolicy policy;
+    policy.plateau_window = 10;
+    policy.sampling = RestartPolicy::Perturb;
+    RestartMonitor monitor;
+    monitor.setPolicy(policy);
+    monitor.reset();
+
+    std::default_random_engine rng(16);
+    KDL::JntArray q(2);
+    q(0) = 1.0;
+
+    // a residual that keeps halving never plateaus
+    double residual = 1.0;
+    for (int i = 0; i < 100; ++i) {
+        residual *= 0.5;
+        ASSERT_FALSE(monitor.update(q, residual)) << i;
+    }
+
+    // a flat residual ends the attempt with the next full window
+    int updates = 1;
+    while (!monitor.update(q, residual)) {
+        ++updates;
+    }
+    EXPECT_EQ(policy.plateau_window, updates);
+    EXPECT_EQ(1u, monitor.counters().plateaus);
+
+    // the next attempt perturbs the best configuration
+    KDL::JntArray next(2);
+    ASSERT_TRUE(monitor.next(next, rng));
+    EXPECT_LE(std::abs(next(0) - 1.0), policy.perturbation);
+    EXPECT_LE(std::abs(next(1)), policy.perturbation);
+    EXPECT_EQ(1u, monitor.counters().perturbations);
+
+    // a stalled attempt always resamples
+    monitor.stalled();
+    EXPECT_FALSE(monitor.next(next, rng));
+
+    policy.plateau_window = 0;
+    policy.max_steps = 5;
+    monitor.setPolicy(policy);
+    monitor.reset();
+    EXPECT_FALSE(monitor.update(q, 1.0, 4));
+    EXPECT_TRUE(monitor.update(q, 0.5, 1));
+    EXPECT_EQ(1u, monitor.counters().step_limits);
+    EXPECT_EQ(3u, monitor.counters().restarts());
+}
+
+TEST(RestartPolicy, SolverCountsRestartsByCause)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 2000, 1e-5, Speed);
+
+    // every attempt toward a target out of reach ends by a restart
+    const KDL::Frame p_in(KDL::Vector(3.0, 0.0, 0.0));
+    const KDL::JntArray seed(6);
+    KDL::JntArray q;
+    ASSERT_EQ(NoSolution, ik.CartToJnt(seed, p_in, q));
+    EXPECT_EQ(0u, ik.getRestartCounters().plateaus);
+    EXPECT_EQ(0u, ik.getRestartCounters().step_limits);
+
+    RestartPolicy policy;
+    policy.max_steps = 20;
+    policy.sampling = RestartPolicy::Perturb;
+    ik.setRestartPolicy(policy);
+    ik.resetRestartCounters();
+    ASSERT_EQ(NoSolution, ik.CartToJnt(seed, p_in, q));
+    const RestartCounters counters = ik.getRestartCounters();
+    EXPECT_GT(counters.step_limits, 0u);
+    EXPECT_GT(counters.perturbations, 0u);
+    EXPECT_LE(counters.perturbations, counters.step_limits);
+
+    ik.resetRestartCounters();
+    EXPECT_EQ(0u, ik.getRestartCounters().restarts());
+}
+
+TEST(CostBudget, CostModelChargesEvaluationsPerJoint)
+{
+    WorkCounters work;
+    work.fk = 3;
+    work.jacobian = 2;
+    work.svd = 1;
+
+    CostModel model;
+    model.fk = 1.0;
+    model.jacobian = 2.0;
+    model.svd = 4.0;
+    EXPECT_DOUBLE_EQ(6 * (3.0 + 4.0 + 4.0), model.cost(work, 6));
+
+    WorkCounters total = work;
+    total += work;
+    EXPECT_EQ(6u, total.fk);
+    EXPECT_EQ(2u, (total - work).jacobian);
+}
+
+TEST(CostBudget, BoundsSearchesInsteadOfIterations)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 1000000, 1e-5, Speed);
+
+    const double budget = 1e5;
+    ik.setCostBudget(budget);
+
+    // a search toward a target out of reach spends the whole budget, and
+    // stops within a round of it
+    const KDL::Frame p_in(KDL::Vector(3.0, 0.0, 0.0));
+    const KDL::JntArray seed(6);
+    KDL::JntArray q;
+    EXPECT_EQ(NoSolution, ik.CartToJnt(seed, p_in, q));
+    const double spent = ik.getLastCost();
+    EXPECT_GE(spent, budget);
+    EXPECT_LT(spent, 1.5 * budget);
+
+    // the cost does not depend on the load of the machine
+    EXPECT_EQ(NoSolution, ik.CartToJnt(seed, p_in, q));
+    EXPECT_EQ(spent, ik.getLastCost());
+
+    ik.setCostBudget(2 * budget);
+    EXPECT_EQ(NoSolution, ik.CartToJnt(seed, p_in, q));
+    EXPECT_GE(ik.getLastCost(), 2 * budget);
+
+    std::default_random_engine rng(19);
+    const KDL::Frame reachable = TipFrame(chain, RandomConfiguration(rng, q_min, q_max, 0.5));
+    ASSERT_GE(ik.CartToJnt(seed, reachable, q), 0);
+    EXPECT_GT(ik.getLastCost(), 0.0);
+    EXPECT_LT(ik.getLastCost(), 2 * budget);
+}
+
+} // namespace Deterministic_TRAC_IK
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,270 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+// standard includes
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+
+// system includes
+#include <gtest/gtest.h>
+
+// project includes
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/ik_cache.hpp>
+#include "test_chains.hpp"
+#include "test_files.hpp"
+
+namespace Deterministic_TRAC_IK {
+namespace {
+
+// snapshots are tagged with the chain the cache was filled for; the keys
+// and configurations below are for a chain of two joints
+const uint64_t Signature = 7;
+const unsigned int NumJoints = 2;
+
+bool AcceptAll(const KDL::JntArray&) { return true; }
+
+IKCache::Key PoseKey(const IKCache& cache, double x)
+{
+    const KDL::Frame p(KDL::Rotation::RPY(0.1, 0.2, 0.3), KDL::Vector(x, 0.2, 0.3));
+    return cache.makeKey(KDL::JntArray(NumJoints), p, KDL::Twist::Zero(), KDL::JntArray(), 0);
+}
+
+KDL::JntArray Configuration(double value)
+{
+    KDL::JntArray q(NumJoints);
+    q(0) = value;
+    q(1) = -value;
+    return q;
+}
+
+bool Contains(IKCache& cache, double x)
+{
+    KDL::JntArray q;
+    int rc;
+    return cache.lookup(PoseKey(cache, x), q, rc, AcceptAll);
+}
+
+} // namespace
+
+TEST(IKCache, QuantizesNearbyQueriesToOneKey)
+{
+    IKCache cache(16, 1e-2, 1e-2);
+    EXPECT_EQ(PoseKey(cache, 0.101), PoseKey(cache, 0.1012));
+    EXPECT_NE(PoseKey(cache, 0.101), PoseKey(cache, 0.121));
+
+    // the solve type and consistency limits are part of the key
+    const KDL::Frame p(KDL::Vector(0.1, 0.2, 0.3));
+    const KDL::JntArray seed(2);
+    KDL::JntArray limits(2);
+    limits(0) = 0.5;
+    limits(1) = 0.5;
+    EXPECT_NE(cache.makeKey(seed, p, KDL::Twist::Zero(), KDL::JntArray(), 0),
+              cache.makeKey(seed, p, KDL::Twist::Zero(), KDL::JntArray(), 1));
+    EXPECT_NE(cache.makeKey(seed, p, KDL::Twist::Zero(), KDL::JntArray(), 0),
+              cache.makeKey(seed, p, KDL::Twist::Zero(), limits, 0));
+}
+
+TEST(IKCache, EvictsTheLeastRecentlyUsedEntry)
+{
+    IKCache cache(3);
+    for (int i = 0; i < 3; ++i) {
+        cache.insert(PoseKey(cache, 0.1 * i), Configuration(i), 0);
+    }
+
+    // touch the oldest entry so that the second one is evicted instead
+    ASSERT_TRUE(Contains(cache, 0.0));
+    cache.insert(PoseKey(cache, 0.3), Configuration(3), 0);
+
+    EXPECT_EQ(3u, cache.size());
+    EXPECT_TRUE(Contains(cache, 0.0));
+    EXPECT_FALSE(Contains(cache, 0.1));
+    EXPECT_TRUE(Contains(cache, 0.2));
+    EXPECT_TRUE(Contains(cache, 0.3));
+}
+
+TEST(IKCache, LookupHonorsTheAcceptPredicate)
+{
+    IKCache cache(4);
+    cache.insert(PoseKey(cache, 0.1), Configuration(1.0), -3);
+
+    KDL::JntArray q;
+    int rc = 0;
+    EXPECT_FALSE(cache.lookup(PoseKey(cache, 0.1), q, rc, [](const KDL::JntArray&) { return false; }));
+    EXPECT_EQ(0u, cache.hits());
+    EXPECT_EQ(1u, cache.misses());
+
+    ASSERT_TRUE(cache.lookup(PoseKey(cache, 0.1), q, rc, AcceptAll));
+    EXPECT_EQ(Configuration(1.0).data, q.data);
+    EXPECT_EQ(-3, rc);
+    EXPECT_EQ(1u, cache.hits());
+
+    cache.resetCounters();
+    EXPECT_EQ(0u, cache.hits());
+    EXPECT_EQ(0u, cache.misses());
+}
+
+TEST(IKCache, SolverReusesCachedSolutions)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 5000, 1e-5, Speed);
+    std::shared_ptr<IKCache> cache(new IKCache);
+    ik.setCache(cache);
+
+    std::default_random_engine rng(4);
+    const KDL::Frame p_in = TipFrame(chain, RandomConfiguration(rng, q_min, q_max, 0.5));
+    const KDL::JntArray seed(6);
+
+    KDL::JntArray first, second;
+    ASSERT_GE(ik.CartToJnt(seed, p_in, first), 0);
+    EXPECT_EQ(0u, cache->hits());
+    EXPECT_EQ(1u, cache->size());
+
+    ASSERT_GE(ik.CartToJnt(seed, p_in, second), 0);
+    EXPECT_EQ(1u, cache->hits());
+    EXPECT_EQ(first.data, second.data);
+}
+
+TEST(IKCache, SnapshotPreservesTheEvictionOrder)
+{
+    TempFile file("ik_cache");
+    IKCache cache(8);
+    for (int i = 0; i < 4; ++i) {
+        cache.insert(PoseKey(cache, 0.1 * i), Configuration(i), i);
+    }
+    ASSERT_TRUE(Contains(cache, 0.0));
+    ASSERT_TRUE(cache.save(file.path(), Signature, NumJoints));
+
+    // with room for only two entries, the two most recently used survive
+    IKCache loaded(2);
+    ASSERT_TRUE(loaded.load(file.path(), Signature, NumJoints));
+    EXPECT_EQ(2u, loaded.size());
+    EXPECT_TRUE(Contains(loaded, 0.0));
+    EXPECT_TRUE(Contains(loaded, 0.3));
+
+    KDL::JntArray q;
+    int rc;
+    ASSERT_TRUE(loaded.lookup(PoseKey(loaded, 0.3), q, rc, AcceptAll));
+    EXPECT_EQ(Configuration(3).data, q.data);
+    EXPECT_EQ(3, rc);
+
+    IKCache other_resolution(8, 1e-3);
+    EXPECT_FALSE(other_resolution.load(file.path(), Signature, NumJoints));
+    EXPECT_EQ(0u, other_resolution.size());
+}
+
+TEST(IKCache, RejectsTruncatedSnapshots)
+{
+    TempFile file("ik_cache");
+    IKCache cache(8);
+    for (int i = 0; i < 4; ++i) {
+        cache.insert(PoseKey(cache, 0.1 * i), Configuration(i), 0);
+    }
+    ASSERT_TRUE(cache.save(file.path(), Signature, NumJoints));
+
+    const std::string data = ReadFile(file.path());
+    WriteFile(file.path(), data.substr(0, data.size() - 1));
+    IKCache loaded(8);
+    EXPECT_FALSE(loaded.load(file.path(), Signature, NumJoints));
+    EXPECT_EQ(3u, loaded.size());
+
+    IKCache missing(8);
+    EXPECT_FALSE(missing.load(file.path() + ".missing", Signature, NumJoints));
+}
+
+TEST(IKCache, MergesSnapshotsOfSeveralCaches)
+{
+    TempFile file("ik_cache");
+    IKCache first(8);
+    IKCache second(8);
+    for (int i = 0; i < 3; ++i) {
+        first.insert(PoseKey(first, 0.1 * i), Configuration(i), 0);
+        second.insert(PoseKey(second, 0.1 * (i + 3)), Configuration(i + 3), 0);
+    }
+    ASSERT_TRUE(first.save(file.path(), Signature, NumJoints));
+    ASSERT_TRUE(second.save(file.path(), Signature, NumJoints));
+
+    IKCache loaded(8);
+    ASSERT_TRUE(loaded.load(file.path(), Signature, NumJoints));
+    EXPECT_EQ(6u, loaded.size());
+
+    // the entries of the last save are the most recently used
+    IKCache small(3);
+    ASSERT_TRUE(small.load(file.path(), Signature, NumJoints));
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_FALSE(Contains(small, 0.1 * i)) << i;
+        EXPECT_TRUE(Contains(small, 0.1 * (i + 3))) << i;
+    }
+}
+
+TEST(IKCache, RejectsSnapshotsOfOtherChains)
+{
+    TempFile file("ik_cache");
+    IKCache cache(8);
+    cache.insert(PoseKey(cache, 0.1), Configuration(1), 0);
+    ASSERT_TRUE(cache.save(file.path(), Signature, NumJoints));
+
+    IKCache loaded(8);
+    EXPECT_FALSE(loaded.load(file.path(), Signature + 1, NumJoints));
+    EXPECT_FALSE(loaded.load(file.path(), Signature, NumJoints + 1));
+    EXPECT_EQ(0u, loaded.size());
+}
+
+TEST(IKCache, BoundsTheEntryCountByTheFileSize)
+{
+    TempFile file("ik_cache");
+    IKCache cache(8);
+    cache.insert(PoseKey(cache, 0.1), Configuration(1), 0);
+    ASSERT_TRUE(cache.save(file.path(), Signature, NumJoints));
+
+    // magic, version, chain signature, joint count, and resolutions precede
+    // the entry count
+    std::string data = ReadFile(file.path());
+    const size_t count_offset = 8 + 4 + 8 + 4 + 2 * 8;
+    const uint64_t huge = ~uint64_t(0);
+    ASSERT_LE(count_offset + sizeof(huge), data.size());
+    std::memcpy(&data[count_offset], &huge, sizeof(huge));
+    WriteFile(file.path(), data);
+
+    IKCache loaded(8);
+    EXPECT_FALSE(loaded.load(file.path(), Signature, NumJoints));
+    EXPECT_EQ(0u, loaded.size());
+}
+
+} // namespace Deterministic_TRAC_IK
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,162 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+// standard includes
+#include <cmath>
+#include <random>
+
+// system includes
+#include <gtest/gtest.h>
+
+// project includes
+#include <deterministic_trac_ik/kdl_tl.hpp>
+#include "test_chains.hpp"
+
+namespace Deterministic_TRAC_IK {
+namespace {
+
+double Residual(const KDL::Chain& chain, const KDL::JntArray& q, const KDL::Frame& target)
+{
+    const KDL::Twist error = KDL::diff(TipFrame(chain, q), target);
+    return std::sqrt(KDL::dot(error.vel, error.vel) + KDL::dot(error.rot, error.rot));
+}
+
+// Return the number of \p runs, from random seeds toward random targets,
+// in which \p solver converges within \p steps.
+int CountConverged(KDL::ChainIkSolverPos_TL& solver, int runs, int steps)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+
+    std::default_random_engine rng(13);
+    int converged = 0;
+    for (int i = 0; i < runs; ++i) {
+        const KDL::Frame target = TipFrame(chain, RandomConfiguration(rng, q_min, q_max));
+        solver.restart(RandomConfiguration(rng, q_min, q_max), target);
+        // a random restart ends a call to step() early, so take the steps
+        // one at a time
+        for (int k = 0; k < steps; ++k) {
+            if (solver.step() == 0) {
+                EXPECT_TRUE(KDL::Equal(TipFrame(chain, solver.qout()), target, 1e-4)) << i;
+                ++converged;
+                break;
+            }
+        }
+    }
+    return converged;
+}
+
+} // namespace
+
+TEST(LineSearch, ConvergesInFewerSteps)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+
+    // full steps that overshoot oscillate until the stall detection gives
+    // up on them; halved ones keep descending, and a local minimum restarts
+    // at once
+    KDL::ChainIkSolverPos_TL plain(chain, q_min, q_max, 1e-5, true, false);
+    KDL::ChainIkSolverPos_TL searching(chain, q_min, q_max, 1e-5, true, false);
+    searching.setLineSearch(3);
+    EXPECT_GT(CountConverged(searching, 50, 200), CountConverged(plain, 50, 200));
+}
+
+TEST(ActiveSet, OtherJointsAbsorbTheErrorOfASaturatedOne)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+
+    // holding a joint out leaves fewer joints than task rows, so damp the
+    // steps near the resulting singularities
+    const KDL::AdaptiveDamping damping(0.05, 0.1);
+    KDL::ChainIkSolverPos_TL plain(chain, q_min, q_max, 1e-5, false, false);
+    KDL::ChainIkSolverPos_TL active(chain, q_min, q_max, 1e-5, false, false);
+    plain.setDamping(damping);
+    active.setDamping(damping);
+    active.setActiveSet(true);
+
+    // the second joint starts on its upper limit, and the target lies
+    // beyond it, so every unconstrained step pushes the joint further out
+    std::default_random_engine rng(15);
+    std::uniform_real_distribution<double> offset(-0.1, 0.1);
+    for (int i = 0; i < 10; ++i) {
+        KDL::JntArray seed = RandomConfiguration(rng, q_min, q_max, 0.5);
+        seed(1) = q_max(1);
+        KDL::JntArray beyond = seed;
+        for (unsigned int j = 0; j < 6; ++j) {
+            beyond(j) += offset(rng);
+        }
+        beyond(1) = q_max(1) + 0.3;
+        const KDL::Frame target = TipFrame(chain, beyond);
+
+        plain.restart(seed, target);
+        active.restart(seed, target);
+        plain.step(10);
+        active.step(10);
+        EXPECT_EQ(q_max(1), active.qout()(1)) << i;
+        EXPECT_LT(Residual(chain, active.qout(), target), 0.5 * Residual(chain, plain.qout(), target)) << i;
+    }
+}
+
+TEST(VelSolver, DampsOnlyThePseudoInverseByRequest)
+{
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(4, q_min, q_max);
+
+    KDL::ChainIkSolverPos_TL solver(chain, q_min, q_max, 1e-5, false, false);
+    EXPECT_EQ(0.0, solver.damping().max_damping);
+
+    // with fewer joints than task rows J J^T is singular, so the undamped
+    // least-squares step would not be finite
+    std::default_random_engine rng(16);
+    const KDL::JntArray seed = RandomConfiguration(rng, q_min, q_max, 0.5);
+    const KDL::Frame target = TipFrame(chain, RandomConfiguration(rng, q_min, q_max, 0.5));
+    const KDL::VelSolverType types[] = { KDL::VelSolverDLS, KDL::VelSolverTranspose };
+    for (KDL::VelSolverType type : types) {
+        solver.setVelSolver(type);
+        EXPECT_GT(solver.damping().max_damping, 0.0) << type;
+        solver.restart(seed, target);
+        solver.step(10);
+        EXPECT_TRUE(solver.qout().data.allFinite()) << type;
+        EXPECT_LT(Residual(chain, solver.qout(), target), Residual(chain, seed, target)) << type;
+    }
+
+    solver.setVelSolver(KDL::VelSolverPinv);
+    EXPECT_EQ(0.0, solver.damping().max_damping);
+}
+
+} // namespace Deterministic_TRAC_IK
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,214 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+// standard includes
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// system includes
+#include <gtest/gtest.h>
+
+// project includes
+#include <deterministic_trac_ik/analytic_solver.hpp>
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/query_log.hpp>
+#include "test_chains.hpp"
+#include "test_files.hpp"
+
+namespace Deterministic_TRAC_IK {
+namespace {
+
+QueryRecord MakeRecord(int i)
+{
+    QueryRecord record;
+    record.pose = KDL::Frame(KDL::Vector(0.01 * i, 0.2, 0.3));
+    record.seed = KDL::JntArray(6);
+    record.seed(0) = i;
+    record.result = i;
+    return record;
+}
+
+} // namespace
+
+TEST(QueryLog, RecordsSolverQueries)
+{
+    TempFile file("query_log");
+    KDL::JntArray q_min, q_max;
+    const KDL::Chain chain = MakeArm(6, q_min, q_max);
+
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 1000, 1e-5, Distance);
+    ik.setPerQuerySeeding(true, 17);
+    ik.setLineSearch(3);
+
+    std::shared_ptr<QueryLog> log(new QueryLog);
+    ASSERT_TRUE(log->open(file.path(), 6, 16, ChainSignature(chain), ik.getSolverOptions()));
+    ik.setQueryLog(log);
+
+    std::default_random_engine rng(18);
+    const KDL::JntArray seed = RandomConfiguration(rng, q_min, q_max, 0.5);
+    const KDL::Frame reachable = TipFrame(chain, RandomConfiguration(rng, q_min, q_max, 0.5));
+    const KDL::Frame unreachable(KDL::Vector(3.0, 0.0, 0.0));
+    KDL::JntArray limits(6);
+    for (unsigned int j = 0; j < 6; ++j) {
+        limits(j) = 0.5;
+    }
+
+    KDL::JntArray solution, q;
+    const int rc = ik.CartToJnt(seed, reachable, solution);
+    ASSERT_GE(rc, 0);
+    ik.CartToJnt(seed, unreachable, q, KDL::Twist::Zero(), limits);
+    EXPECT_EQ(2u, log->count());
+
+    std::vector<QueryRecord> records;
+    uint64_t signature = 0;
+    SolverOptions options;
+    ASSERT_TRUE(QueryLog::read(file.path(), records, signature, options));
+    EXPECT_EQ(ChainSignature(chain), signature);
+    EXPECT_TRUE(options == ik.getSolverOptions());
+    EXPECT_EQ(3, options.line_search);
+    ASSERT_EQ(2u, records.size());
+
+    const QueryRecord& solved = records[0];
+    EXPECT_TRUE(KDL::Equal(reachable, solved.pose, 1e-12));
+    EXPECT_EQ(seed.data, solved.seed.data);
+    EXPECT_EQ(0u, solved.consistency_limits.data.size());
+    EXPECT_EQ(Distance, solved.solve_type);
+    EXPECT_EQ(1000, solved.max_iterations);
+    EXPECT_TRUE(solved.per_query_seeding);
+    EXPECT_EQ(17u, solved.seed_salt);
+    EXPECT_FALSE(solved.filtered);
+    EXPECT_EQ(rc, solved.result);
+    EXPECT_EQ(solution.data, solved.solution.data);
+    EXPECT_GT(solved.iterations, 0u);
+
+    const QueryRecord& failed = records[1];
+    EXPECT_EQ(limits.data, failed.consistency_limits.data);
+    EXPECT_LT(failed.result, 0);
+    EXPECT_EQ(0u, failed.solution.data.size());
+
+    // with per-query seeding, a fresh solver with the logged options
+    // reproduces the logged result
+    Deterministic_TRAC_IK replay(chain, q_min, q_max, solved.max_iterations, solved.eps, SolveType(solved.solve_type));
+    replay.setSolverOptions(options);
+    replay.setPerQuerySeeding(solved.per_query_seeding, solved.seed_salt);
+    KDL::JntArray replayed;
+    EXPECT_EQ(solved.result, replay.CartToJnt(solved.seed, solved.pose, replayed, solved.bounds));
+    EXPECT_EQ(solved.solution.data, replayed.data);
+}
+
+TEST(QueryLog, KeepsTheNewestRecordsOfAFullRing)
+{
+    TempFile file("query_log");
+    QueryLog log;
+    ASSERT_TRUE(log.open(file.path(), 6, 4, 99, SolverOptions()));
+    for (int i = 0; i < 10; ++i) {
+        log.record(MakeRecord(i));
+    }
+    log.close();
+
+    std::vector<QueryRecord> records;
+    uint64_t signature = 0;
+    SolverOptions options;
+    ASSERT_TRUE(QueryLog::read(file.path(), records, signature, options));
+    ASSERT_EQ(4u, records.size());
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(6 + i, records[i].result);
+        EXPECT_EQ(6 + i, records[i].seed(0));
+    }
+
+    // reopening for the same chain and options appends, for others replaces
+    QueryLog same;
+    ASSERT_TRUE(same.open(file.path(), 6, 4, 99, SolverOptions()));
+    EXPECT_EQ(10u, same.count());
+    same.close();
+
+    SolverOptions line_search;
+    line_search.line_search = 3;
+    QueryLog other_options;
+    ASSERT_TRUE(other_options.open(file.path(), 6, 4, 99, line_search));
+    EXPECT_EQ(0u, other_options.count());
+    other_options.close();
+
+    QueryLog other_chain;
+    ASSERT_TRUE(other_chain.open(file.path(), 6, 4, 100, line_search));
+    EXPECT_EQ(0u, other_chain.count());
+}
+
+TEST(QueryLog, RejectsTruncatedLogs)
+{
+    TempFile file("query_log");
+    QueryLog log;
+    ASSERT_TRUE(log.open(file.path(), 6, 4, 99, SolverOptions()));
+    log.record(MakeRecord(0));
+    log.close();
+
+    const std::string data = ReadFile(file.path());
+    WriteFile(file.path(), data.substr(0, data.size() - 1));
+    std::vector<QueryRecord> records;
+    uint64_t signature = 0;
+    SolverOptions options;
+    EXPECT_FALSE(QueryLog::read(file.path(), records, signature, options));
+    EXPECT_FALSE(QueryLog::read(file.path() + ".missing", records, signature, options));
+}
+
+TEST(QueryLog, RejectsCapacitiesThatOverflowTheFileSize)
+{
+    TempFile file("query_log");
+    QueryLog log;
+    ASSERT_TRUE(log.open(file.path(), 6, 4, 99, SolverOptions()));
+    log.record(MakeRecord(0));
+    log.close();
+
+    // magic, version, and joint count precede the capacity; records are a
+    // multiple of 8 bytes, so adding 2^62 to the capacity leaves the
+    // product of the two, modulo 2^64, and thus the expected size unchanged
+    std::string data = ReadFile(file.path());
+    const size_t capacity_offset = 8 + 4 + 4;
+    const uint64_t capacity = (uint64_t(1) << 62) + 4;
+    ASSERT_LE(capacity_offset + sizeof(capacity), data.size());
+    std::memcpy(&data[capacity_offset], &capacity, sizeof(capacity));
+    WriteFile(file.path(), data);
+
+    std::vector<QueryRecord> records;
+    uint64_t signature = 0;
+    SolverOptions options;
+    EXPECT_FALSE(QueryLog::read(file.path(), records, signature, options));
+}
+
+} // namespace Deterministic_TRAC_IK
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+/********************************************************************************
+Copyright (c) 2015, TRACLabs, Inc.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+    1. Redistributions of source code must retain the above copyright notice,
+       this list of conditions and the following disclaimer.
+
+    2. Redistributions in binary form must reproduce the above copyright notice,
+       this list of conditions and the following disclaimer in the documentation
+       and/or other materials provided with the distribution.
+
+    3. Neither the name of the copyright holder nor the names of its contributors
+       may be used to endorse or promote products derived from this software
+       without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+********************************************************************************/
+
+// standard includes
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+
+// system includes
+#include <gtest/gtest.h>
+
+// project includes
+#include <deterministic_trac_ik/analytic_solver.hpp>
+#include <deterministic_trac_ik/deterministic_trac_ik.hpp>
+#include <deterministic_trac_ik/reachability_map.hpp>
+#include "test_chains.hpp"
+#include "test_files.hpp"
+
+namespace Deterministic_TRAC_IK {
+
+class ReachabilityMapTest : public ::testing::Test
+{
+protected:
+
+    ReachabilityMapTest() :
+        chain(MakeArm(6, q_min, q_max))
+    { }
+
+    void SetUp() override
+    {
+        ASSERT_TRUE(map.build(chain, q_min, q_max, 0.1, 20000, 1));
+    }
+
+    KDL::JntArray q_min;
+    KDL::JntArray q_max;
+    KDL::Chain chain;
+    ReachabilityMap map;
+};
+
+TEST_F(ReachabilityMapTest, SampledPosesAreReachable)
+{
+    std::default_random_engine rng(5);
+    for (int i = 0; i < 100; ++i) {
+        const KDL::Frame p = TipFrame(chain, RandomConfiguration(rng, q_min, q_max));
+        EXPECT_TRUE(map.reachable(p)) << i;
+    }
+}
+
+TEST_F(ReachabilityMapTest, DistantPosesAreUnreachable)
+{
+    // the arm is less than 2 m long
+    const KDL::Frame p(KDL::Vector(3.0, 0.0, 0.0));
+    EXPECT_FALSE(map.reachable(p));
+    EXPECT_FALSE(map.reachable(p, KDL::Twist(KDL::Vector(0.5, 0.5, 0.5), KDL::Vector::Zero())));
+
+    // a free translational axis is not checked against the map
+    const double free = std::numeric_limits<double>::max();
+    EXPECT_TRUE(map.reachable(p, KDL::Twist(KDL::Vector(free, 0.0, 0.0), KDL::Vector::Zero())));
+}
+
+TEST_F(ReachabilityMapTest, SolverRejectsUnreachableTargets)
+{
+    Deterministic_TRAC_IK ik(chain, q_min, q_max, 5000, 1e-5, Speed);
+    ik.setReachabilityMap(std::make_shared<const ReachabilityMap>());
+
+    // an unbuilt map rules nothing out
+    const KDL::JntArray seed(6);
+    KDL::JntArray q;
+    EXPECT_NE(Unreachable, ik.CartToJnt(seed, KDL::Frame(KDL::Vector(3.0, 0.0, 0.0)), q));
+
+    std::shared_ptr<ReachabilityMap> built(new ReachabilityMap);
+    ASSERT_TRUE(built->build(chain, q_min, q_max, 0.1, 20000, 1));
+    ik.setReachabilityMap(built);
+    EXPECT_EQ(Unreachable, ik.CartToJnt(seed, KDL::Frame(KDL::Vector(3.0, 0.0, 0.0)), q));
+
+    std::default_random_engine rng(6);
+    const KDL::Frame p_in = TipFrame(chain, RandomConfiguration(rng, q_min, q_max, 0.5));
+    EXPECT_GE(ik.CartToJnt(seed, p_in, q), 0);
+}
+
+TEST_F(ReachabilityMapTest, BuildDependsOnlyOnTheSeedAndThreads)
+{
+    TempFile first("reachability_map_first");
+    TempFile second("reachability_map_second");
+
+    ReachabilityMap a, b;
+    ASSERT_TRUE(a.build(chain, q_min, q_max, 0.1, 20000, 2, 7));
+    ASSERT_TRUE(b.build(chain, q_min, q_max, 0.1, 20000, 2, 7));
+    ASSERT_TRUE(a.save(first.path()));
+    ASSERT_TRUE(b.save(second.path()));
+    EXPECT_EQ(ReadFile(first.path()), ReadFile(second.path()));
+}
+
+TEST_F(ReachabilityMapTest, LoadsWhatWasSaved)
+{
+    TempFile file("reachability_map");
+    ASSERT_TRUE(map.save(file.path()));
+
+    ReachabilityMap loaded;
+    ASSERT_TRUE(loaded.load(file.path()));
+    EXPECT_EQ(ChainSignature(chain), loaded.chainSignature());
+    EXPECT_EQ(map.resolution(), loaded.resolution());
+
+    std::default_random_engine rng(8);
+    std::uniform_real_distribution<double> position(-2.0, 2.0);
+    std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+    for (int i = 0; i < 1000; ++i) {
+        const KDL::Frame p(
+                KDL::Rotation::RPY(angle(rng), angle(rng), angle(rng)),
+                KDL::Vector(position(rng), position(rng), position(rng)));
+        ASSERT_EQ(map.reachable(p), loaded.reachable(p)) << i;
+    }
+
+    // a truncated file is rejected and leaves the loaded map in place
+    TempFile truncated("reachability_map_truncated");
+    const std::string data = ReadFile(file.path());
+    WriteFile(truncated.path(), data.substr(0, data.size() / 2));
+    EXPECT_FALSE(loaded.load(truncated.path()));
+    EXPECT_TRUE(loaded.valid());
+
+    ReachabilityMap empty;
+    EXPECT_FALSE(empty.load(truncated.path()));
+    EXPECT_FALSE(empty.valid());
+}
+
+} // namespace Deterministic_TRAC_IK
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}